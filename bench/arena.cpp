@@ -0,0 +1,211 @@
+// Arena benchmark: parse the same generated source with the arena-allocated
+// AST of the parser and with the previous layout (one unique_ptr per node,
+// one std::string per name), counting heap allocations and wall time.
+//
+// usage: bench/arena [definitions] [repetitions]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include "../src/parser/Parser.h"
+#include "../src/session/Session.h"
+
+// This counts heap allocations of the whole process
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+    allocations++;
+    if (void *memory = malloc(size)) {
+        return memory;
+    }
+    abort();
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
+
+// previous AST layout, parsed by the same recursive descent
+namespace legacy {
+
+    struct Expression {
+        virtual ~Expression() {}
+    };
+
+    struct NumberLiteral : public Expression {
+        double value;
+        NumberLiteral(double value) : value(value) {}
+    };
+
+    struct VariableReference : public Expression {
+        std::string variable;
+        VariableReference(std::string variable) : variable(variable) {}
+    };
+
+    struct FunctionCall : public Expression {
+        std::string callee;
+        std::vector<std::unique_ptr<Expression>> arguments;
+        FunctionCall(std::string callee, std::vector<std::unique_ptr<Expression>> arguments)
+            : callee(callee), arguments(std::move(arguments)) {}
+    };
+
+    struct BinaryOperation : public Expression {
+        char binary_operator;
+        std::unique_ptr<Expression> lhs, rhs;
+        BinaryOperation(char binary_operator, std::unique_ptr<Expression> lhs, std::unique_ptr<Expression> rhs)
+            : binary_operator(binary_operator), lhs(std::move(lhs)), rhs(std::move(rhs)) {}
+    };
+
+    struct FunctionDeclaration {
+        std::string name;
+        std::vector<std::string> arguments;
+        FunctionDeclaration(std::string name, std::vector<std::string> arguments)
+            : name(name), arguments(std::move(arguments)) {}
+    };
+
+    struct FunctionDefinition {
+        std::unique_ptr<FunctionDeclaration> declaration;
+        std::unique_ptr<Expression> body;
+        FunctionDefinition(std::unique_ptr<FunctionDeclaration> declaration, std::unique_ptr<Expression> body)
+            : declaration(std::move(declaration)), body(std::move(body)) {}
+    };
+
+    std::unique_ptr<Expression> parse_expression(session::CompilerSession &session);
+
+    int get_current_token_precedence(session::CompilerSession &session) {
+        if (!isascii(session.lexer.current_token)) {
+            return -1;
+        }
+        int token_precedence = session.binary_operator_precedences[session.lexer.current_token];
+        return token_precedence <= 0 ? -1 : token_precedence;
+    }
+
+    std::unique_ptr<Expression> parse_primary_expression(session::CompilerSession &session) {
+        if (session.lexer.current_token == lexer::Token::NUMBER) {
+            auto number_literal = std::make_unique<NumberLiteral>(session.lexer.number);
+            session.lexer.get_next_token();
+            return number_literal;
+        }
+        if (session.lexer.current_token == '(') {
+            session.lexer.get_next_token();
+            auto expression = parse_expression(session);
+            session.lexer.get_next_token();
+            return expression;
+        }
+        std::string identifier(session.lexer.identifier);
+        session.lexer.get_next_token();
+        if (session.lexer.current_token != '(') {
+            return std::make_unique<VariableReference>(identifier);
+        }
+        session.lexer.get_next_token();
+        std::vector<std::unique_ptr<Expression>> arguments;
+        while (session.lexer.current_token != ')') {
+            arguments.push_back(parse_expression(session));
+            if (session.lexer.current_token == ',') {
+                session.lexer.get_next_token();
+            }
+        }
+        session.lexer.get_next_token();
+        return std::make_unique<FunctionCall>(identifier, std::move(arguments));
+    }
+
+    std::unique_ptr<Expression> parse_binary_operation_rhs(
+        session::CompilerSession &session, int previous_token_precedence, std::unique_ptr<Expression> lhs
+    ) {
+        while (1) {
+            int current_token_precedence = get_current_token_precedence(session);
+            if (current_token_precedence < previous_token_precedence) {
+                return lhs;
+            }
+            int binary_operator = session.lexer.current_token;
+            session.lexer.get_next_token();
+            auto rhs = parse_primary_expression(session);
+            if (current_token_precedence < get_current_token_precedence(session)) {
+                rhs = parse_binary_operation_rhs(session, current_token_precedence + 1, std::move(rhs));
+            }
+            lhs = std::make_unique<BinaryOperation>(binary_operator, std::move(lhs), std::move(rhs));
+        }
+    }
+
+    std::unique_ptr<Expression> parse_expression(session::CompilerSession &session) {
+        return parse_binary_operation_rhs(session, 0, parse_primary_expression(session));
+    }
+
+    std::unique_ptr<FunctionDefinition> parse_function_definition(session::CompilerSession &session) {
+        session.lexer.get_next_token();
+        std::string identifier(session.lexer.identifier);
+        session.lexer.get_next_token();
+        std::vector<std::string> arguments;
+        while (session.lexer.get_next_token() == lexer::Token::IDENTIFIER) {
+            arguments.emplace_back(session.lexer.identifier);
+        }
+        session.lexer.get_next_token();
+        auto declaration = std::make_unique<FunctionDeclaration>(identifier, arguments);
+        return std::make_unique<FunctionDefinition>(std::move(declaration), parse_expression(session));
+    }
+
+}
+
+// generate definitions with wide and deep expressions
+static std::string generate_source(unsigned definitions) {
+    std::string source;
+    for (unsigned i = 0; i < definitions; i++) {
+        std::string name = "function" + std::to_string(i);
+        source += "def " + name + "(alpha beta gamma)\n";
+        source += "  (alpha * beta + gamma * (alpha - 1.5)) * (beta - gamma * 2)";
+        source += " + " + (i ? "function" + std::to_string(i - 1) : name) + "(alpha + 1, beta * gamma, 3)";
+        source += " - (alpha < beta) * (gamma + alpha * beta * 0.25);\n";
+    }
+    return source;
+}
+
+struct Measure {
+    size_t allocations;
+    double milliseconds;
+};
+
+// parse source repetitions times, with the arena parser if arena
+static Measure parse(const std::string &source, unsigned repetitions, bool arena) {
+    auto start = std::chrono::steady_clock::now();
+    size_t allocations_before = allocations;
+    for (unsigned i = 0; i < repetitions; i++) {
+        session::CompilerSession session;
+        session.lexer.open_buffer(llvm::MemoryBuffer::getMemBuffer(source, "bench", false));
+        session.lexer.get_next_token();
+        while (session.lexer.current_token == lexer::Token::DEFINITION) {
+            if (arena) {
+                parser::parse_function_definition(session);
+            } else {
+                legacy::parse_function_definition(session);
+            }
+            session.lexer.get_next_token();
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return { allocations - allocations_before, std::chrono::duration<double, std::milli>(end - start).count() };
+}
+
+int main(int argc, char **argv) {
+    unsigned definitions = argc > 1 ? atoi(argv[1]) : 10000;
+    unsigned repetitions = argc > 2 ? atoi(argv[2]) : 10;
+    std::string source = generate_source(definitions);
+    printf("%u definitions, %zu bytes, %u repetitions\n", definitions, source.size(), repetitions);
+    // warm up
+    parse(source, 1, true);
+    parse(source, 1, false);
+    Measure unique = parse(source, repetitions, false);
+    Measure arena = parse(source, repetitions, true);
+    printf("%-12s %14s %12s\n", "layout", "allocations", "time (ms)");
+    printf("%-12s %14zu %12.2f\n", "unique_ptr", unique.allocations, unique.milliseconds);
+    printf("%-12s %14zu %12.2f\n", "arena", arena.allocations, arena.milliseconds);
+    printf("arena: %.1fx fewer allocations, %.2fx faster\n",
+        (double) unique.allocations / arena.allocations, unique.milliseconds / arena.milliseconds);
+    return 0;
+}
@@ -0,0 +1,112 @@
+// Bundle benchmark: time the front end of a cold start on generated corpora
+// (see corpus.h), from source text (lexing and parsing) and from a bundle of
+// the same definitions (opening it and reading its items), see bundle/Bundle.h.
+// Every repetition starts from a fresh session, as a new process would.
+// Times are medians of repetitions.
+//
+// usage: bench/bundle [scale] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "llvm/Support/FileSystem.h"
+#include "../src/bundle/Bundle.h"
+#include "../src/parser/Parser.h"
+#include "../src/session/Session.h"
+#include "corpus.h"
+
+static llvm::ExitOnError exit_on_error;
+
+static double elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double median(std::vector<double> times) {
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+// parse definitions of source into session
+static std::vector<ast::Unit<ast::FunctionDefinition>> parse(session::CompilerSession &session, const std::string &source) {
+    std::vector<ast::Unit<ast::FunctionDefinition>> definitions;
+    session.lexer.open_buffer(llvm::MemoryBuffer::getMemBuffer(source, "corpus", false));
+    session.lexer.get_next_token();
+    while (session.lexer.current_token != lexer::Token::END_OF_FILE) {
+        if (session.lexer.current_token == ';') {
+            session.lexer.get_next_token();
+            continue;
+        }
+        session.lexer.start_hash();
+        definitions.push_back(parser::parse_function_definition(session));
+        session.lexer.finish_hash();
+        if (!definitions.back()) {
+            fprintf(stderr, "error: corpus does not parse\n");
+            exit(1);
+        }
+    }
+    return definitions;
+}
+
+int main(int argc, char **argv) {
+    unsigned scale = argc > 1 ? atoi(argv[1]) : 1;
+    unsigned repetitions = argc > 2 ? atoi(argv[2]) : 10;
+    struct {
+        const char *name;
+        std::string source;
+    } corpora[] = {
+        { "deep", corpus::deep(200 * scale, 50) },
+        { "chains", corpus::chains(200 * scale, 100) },
+        { "wide", corpus::wide(200 * scale, 20) },
+        { "many", corpus::many(5000 * scale) },
+    };
+    llvm::SmallString<128> path;
+    if (std::error_code error = llvm::sys::fs::createTemporaryFile("bench", "kbc", path)) {
+        fprintf(stderr, "error: cannot create bundle: %s\n", error.message().c_str());
+        return 1;
+    }
+    printf("%u repetitions\n", repetitions);
+    printf("%-8s %10s %10s %12s %12s %8s\n", "corpus", "text (B)", "bundle (B)", "parse (ms)", "load (ms)", "speedup");
+    for (auto &corpus : corpora) {
+        // write bundle of the corpus
+        {
+            session::CompilerSession session;
+            bundle::Writer writer(session.symbol_table);
+            writer.set_file(corpus.name);
+            for (auto &definition : parse(session, corpus.source)) {
+                writer.add_definition(*definition, llvm::MD5::MD5Result(), { 1, 1 });
+            }
+            exit_on_error(writer.write(path.str().str()));
+        }
+        uint64_t bundle_size = 0;
+        llvm::sys::fs::file_size(path, bundle_size);
+        std::vector<double> parse_times, load_times;
+        for (unsigned i = 0; i < repetitions; i++) {
+            {
+                session::CompilerSession session;
+                auto start = std::chrono::steady_clock::now();
+                auto definitions = parse(session, corpus.source);
+                parse_times.push_back(elapsed(start));
+            }
+            {
+                session::CompilerSession session;
+                std::vector<bundle::Item> items;
+                auto start = std::chrono::steady_clock::now();
+                auto reader = exit_on_error(bundle::Reader::open(path.str().str(), session.symbol_table));
+                bundle::Item item;
+                while (exit_on_error(reader.read_item(item))) {
+                    items.push_back(std::move(item));
+                }
+                load_times.push_back(elapsed(start));
+            }
+        }
+        double parse_milliseconds = median(parse_times);
+        double load_milliseconds = median(load_times);
+        printf("%-8s %10zu %10llu %12.3f %12.3f %7.1fx\n", corpus.name, corpus.source.size(),
+            (unsigned long long) bundle_size, parse_milliseconds, load_milliseconds, parse_milliseconds / load_milliseconds);
+    }
+    llvm::sys::fs::remove(path);
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Corpus generator of the benchmarks. Sources are generated from a fixed
+// seed, so that a corpus is the same from one run (and version) to another.
+
+#ifndef __CORPUS_H__
+#define __CORPUS_H__
+
+#include <random>
+#include <string>
+
+namespace corpus {
+
+    // random expression over variables of depth levels of operators and parentheses
+    inline std::string expression(std::mt19937 &random, const std::string *variables, unsigned count, unsigned depth) {
+        if (depth == 0) {
+            if (random() % 4 == 0) {
+                std::string integer = std::to_string(random() % 100);
+                return integer + "." + std::to_string(random() % 100);
+            }
+            return variables[random() % count];
+        }
+        static const char operators[] = { '+', '-', '*', '<' };
+        std::string lhs = expression(random, variables, count, depth - 1);
+        // mostly leaves on the right, so that size grows linearly with depth
+        std::string rhs = expression(random, variables, count, random() % 4 == 0 ? 1 : 0);
+        return "(" + lhs + " " + operators[random() % 4] + " " + rhs + ")";
+    }
+
+    // definitions whose bodies are expression trees depth deep
+    inline std::string deep(unsigned definitions, unsigned depth, unsigned seed = 1) {
+        std::mt19937 random(seed);
+        const std::string variables[] = { "alpha", "beta", "gamma" };
+        std::string source;
+        for (unsigned i = 0; i < definitions; i++) {
+            source += "def deep" + std::to_string(i) + "(alpha beta gamma)\n  ";
+            source += expression(random, variables, 3, depth) + ";\n";
+        }
+        return source;
+    }
+
+    // definitions whose bodies are chains of length binary operators, without parentheses
+    inline std::string chains(unsigned definitions, unsigned length, unsigned seed = 1) {
+        std::mt19937 random(seed);
+        static const char operators[] = { '+', '-', '*', '<' };
+        const std::string variables[] = { "alpha", "beta", "gamma" };
+        std::string source;
+        for (unsigned i = 0; i < definitions; i++) {
+            source += "def chain" + std::to_string(i) + "(alpha beta gamma)\n  " + variables[random() % 3];
+            for (unsigned j = 0; j < length; j++) {
+                source += std::string(" ") + operators[random() % 4] + " " + variables[random() % 3];
+            }
+            source += ";\n";
+        }
+        return source;
+    }
+
+    // definitions of arguments arguments, each calling the previous one with all of them
+    inline std::string wide(unsigned definitions, unsigned arguments, unsigned seed = 1) {
+        std::mt19937 random(seed);
+        std::string source;
+        for (unsigned i = 0; i < definitions; i++) {
+            std::string name = "wide" + std::to_string(i);
+            source += "def " + name + "(";
+            for (unsigned j = 0; j < arguments; j++) {
+                source += (j ? " a" : "a") + std::to_string(j);
+            }
+            source += ")\n  " + (i ? "wide" + std::to_string(i - 1) : std::string("a0 +")) + (i ? "(" : " ");
+            for (unsigned j = 0; j < arguments; j++) {
+                std::string argument = "a" + std::to_string(random() % arguments);
+                source += (j ? (i ? ", " : " + ") : "") + argument + " * " + std::to_string(random() % 10);
+            }
+            source += i ? ");\n" : ";\n";
+        }
+        return source;
+    }
+
+    // many small definitions, each calling a few earlier ones
+    inline std::string many(unsigned definitions, unsigned seed = 1) {
+        std::mt19937 random(seed);
+        std::string source;
+        for (unsigned i = 0; i < definitions; i++) {
+            source += "def many" + std::to_string(i) + "(x y) x * " + std::to_string(random() % 100) + " + y";
+            for (unsigned j = 0; i && j < 2; j++) {
+                source += " - many" + std::to_string(random() % i) + "(y, x + " + std::to_string(j) + ")";
+            }
+            source += ";\n";
+        }
+        return source;
+    }
+
+}
+
+#endif
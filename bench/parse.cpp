@@ -0,0 +1,150 @@
+// Parse benchmark: parse throughput over long chains of binary operators
+// (see corpus.h), where the parser looks up the precedence of every token.
+// The lookups of the token stream are also timed alone, with the table of
+// the parser and with the previous ones (a std::map, an isascii test).
+// Times are medians of repetitions.
+//
+// usage: bench/parse [definitions] [repetitions]
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+#include "../src/parser/Parser.h"
+#include "../src/session/Session.h"
+#include "corpus.h"
+
+static double elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double median(std::vector<double> times) {
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+// precedence lookups of the parser, past and present
+namespace lookup {
+
+    // std::map of characters, after an isascii test
+    struct Map {
+        std::map<char, int> precedences;
+        Map() {
+            for (int i = 0; i < 256; i++) {
+                if (session::BUILTIN_BINARY_OPERATOR_PRECEDENCES[i] > 0) {
+                    precedences[i] = session::BUILTIN_BINARY_OPERATOR_PRECEDENCES[i];
+                }
+            }
+        }
+        int operator()(int token) {
+            if (!isascii(token)) {
+                return -1;
+            }
+            int precedence = precedences[token];
+            return precedence <= 0 ? -1 : precedence;
+        }
+    };
+
+    // table of characters, after an isascii test
+    struct Array {
+        std::array<int, 256> precedences = session::BUILTIN_BINARY_OPERATOR_PRECEDENCES;
+        int operator()(int token) {
+            if (!isascii(token)) {
+                return -1;
+            }
+            int precedence = precedences[token];
+            return precedence <= 0 ? -1 : precedence;
+        }
+    };
+
+    // table of characters, -1 for non operators, with a bounds check (the parser)
+    struct Table {
+        std::array<int, 256> precedences = session::BUILTIN_BINARY_OPERATOR_PRECEDENCES;
+        int operator()(int token) {
+            unsigned index = token;
+            return index < precedences.size() ? precedences[index] : -1;
+        }
+    };
+
+}
+
+// median time of looking up the precedence of every token, repetitions times
+template <typename Lookup>
+static double time_lookups(const std::vector<int> &tokens, unsigned repetitions) {
+    Lookup lookup;
+    std::vector<double> times;
+    long sum = 0;
+    for (unsigned i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int token : tokens) {
+            sum += lookup(token);
+        }
+        times.push_back(elapsed(start));
+    }
+    // use the lookups, so that they are not optimized away
+    if (sum == 42) {
+        printf("\n");
+    }
+    return median(times);
+}
+
+// median time of parsing source, repetitions times
+static double time_parse(const std::string &source, unsigned repetitions) {
+    std::vector<double> times;
+    for (unsigned i = 0; i < repetitions; i++) {
+        session::CompilerSession session;
+        session.lexer.open_buffer(llvm::MemoryBuffer::getMemBuffer(source, "corpus", false));
+        std::vector<ast::Unit<ast::FunctionDefinition>> definitions;
+        auto start = std::chrono::steady_clock::now();
+        session.lexer.get_next_token();
+        while (session.lexer.current_token != lexer::Token::END_OF_FILE) {
+            if (session.lexer.current_token == ';') {
+                session.lexer.get_next_token();
+                continue;
+            }
+            definitions.push_back(parser::parse_function_definition(session));
+            if (!definitions.back()) {
+                fprintf(stderr, "error: corpus does not parse\n");
+                exit(1);
+            }
+        }
+        times.push_back(elapsed(start));
+    }
+    return median(times);
+}
+
+int main(int argc, char **argv) {
+    unsigned definitions = argc > 1 ? atoi(argv[1]) : 1000;
+    unsigned repetitions = argc > 2 ? atoi(argv[2]) : 10;
+    std::string source = corpus::chains(definitions, 500);
+    // token stream of the corpus
+    std::vector<int> tokens;
+    {
+        session::CompilerSession session;
+        session.lexer.open_buffer(llvm::MemoryBuffer::getMemBuffer(source, "corpus", false));
+        while (session.lexer.get_next_token() != lexer::Token::END_OF_FILE) {
+            tokens.push_back(session.lexer.current_token);
+        }
+    }
+    printf("%u definitions, %zu bytes, %zu tokens, %u repetitions\n", definitions, source.size(), tokens.size(), repetitions);
+    double milliseconds = time_parse(source, repetitions);
+    printf("parse: %.2f ms, %.2f MB/s, %.2f Mtokens/s\n", milliseconds,
+        source.size() / milliseconds / 1000, tokens.size() / milliseconds / 1000);
+    printf("%-16s %12s %12s\n", "lookup", "time (ms)", "ns/token");
+    struct {
+        const char *name;
+        double milliseconds;
+    } lookups[] = {
+        { "map", time_lookups<lookup::Map>(tokens, repetitions) },
+        { "isascii + array", time_lookups<lookup::Array>(tokens, repetitions) },
+        { "table", time_lookups<lookup::Table>(tokens, repetitions) },
+    };
+    for (auto &lookup : lookups) {
+        printf("%-16s %12.3f %12.3f\n", lookup.name, lookup.milliseconds, lookup.milliseconds * 1e6 / tokens.size());
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Recursion benchmark: run recursive definitions to a given depth, with and
+// without optimization, measuring time and the stack used per recursive call.
+// Calls in tail position are tail calls (and self-recursive ones loops once
+// optimized), so their stack use should not grow with depth.
+//
+// usage: bench/recursion [depth] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "llvm/Support/TargetSelect.h"
+#include "../src/jit/JIT.h"
+#include "../src/parser/Parser.h"
+#include "../src/session/Session.h"
+
+// These are the lowest stack address reached, and the stack address of the caller of the definitions
+static uintptr_t stack_low;
+static uintptr_t stack_top;
+
+// called by the definitions at their deepest point (exported to the JIT)
+extern "C" double probe(double x) {
+    char local;
+    stack_low = std::min(stack_low, (uintptr_t) &local);
+    return x;
+}
+
+struct Program {
+    const char *name;
+    const char *source;
+    // function to call with the depth
+    const char *function;
+};
+
+static const Program programs[] = {
+    {
+        "self tail",
+        "extern probe(x);\n"
+        "def count(n acc) if n < 1 then probe(acc) else count(n - 1, acc + 1);\n"
+        "def run(n) count(n, 0);\n",
+        "run",
+    },
+    {
+        "mutual tail",
+        "extern probe(x);\n"
+        "extern odd(n);\n"
+        "def even(n) if n < 1 then probe(1) else odd(n - 1);\n"
+        "def odd(n) if n < 1 then probe(0) else even(n - 1);\n",
+        "even",
+    },
+    {
+        "not tail",
+        "extern probe(x);\n"
+        "def sum(n) if n < 1 then probe(0) else n + sum(n - 1);\n",
+        "sum",
+    },
+};
+
+static llvm::ExitOnError exit_on_error;
+
+// compile program at optimization level, return its function
+static double (*compile(jit::KaleidoscopeJIT &jit, const Program &program, unsigned level))(double) {
+    session::Options options;
+    options.optimization_level = level;
+    session::CompilerSession session(options);
+    session.lexer.open_buffer(llvm::MemoryBuffer::getMemBuffer(program.source, program.name, false));
+    session.initialize_module(program.name);
+    session.module -> setDataLayout(jit.get_data_layout());
+    session.lexer.get_next_token();
+    while (session.lexer.current_token != lexer::Token::END_OF_FILE) {
+        if (session.lexer.current_token == lexer::Token::DEFINITION) {
+            auto definition = parser::parse_function_definition(session);
+            session.simplify(definition);
+            definition -> codegen(session);
+        } else if (session.lexer.current_token == lexer::Token::EXTERN) {
+            auto declaration = parser::parse_extern_function(session);
+            declaration -> codegen(session);
+            session.declare_function(*declaration);
+        } else {
+            session.lexer.get_next_token();
+        }
+    }
+    if (session.errors) {
+        fprintf(stderr, "error: %s does not compile\n", program.name);
+        exit(1);
+    }
+    exit_on_error(jit.add_module(llvm::orc::ThreadSafeModule(std::move(session.module), std::move(session.context))));
+    return (double (*)(double)) (intptr_t) exit_on_error(jit.lookup(program.function)).getAddress();
+}
+
+int main(int argc, char **argv) {
+    unsigned depth = argc > 1 ? atoi(argv[1]) : 50000;
+    unsigned repetitions = argc > 2 ? atoi(argv[2]) : 5;
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    printf("depth %u, %u repetitions\n", depth, repetitions);
+    printf("%-12s %6s %12s %14s\n", "program", "level", "time (ms)", "stack (B/call)");
+    for (auto &program : programs) {
+        for (unsigned level : { 0, 2 }) {
+            auto jit = exit_on_error(jit::KaleidoscopeJIT::create());
+            auto function = compile(*jit, program, level);
+            // fastest run, and stack used by the deepest one
+            double milliseconds = 0;
+            size_t stack_bytes = 0;
+            for (unsigned i = 0; i < repetitions; i++) {
+                char local;
+                stack_top = stack_low = (uintptr_t) &local;
+                auto start = std::chrono::steady_clock::now();
+                function(depth);
+                double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                milliseconds = i ? std::min(milliseconds, elapsed) : elapsed;
+                stack_bytes = std::max(stack_bytes, (size_t) (stack_top - stack_low));
+            }
+            printf("%-12s %5s%u %12.3f %14.2f\n", program.name, "-O", level, milliseconds, (double) stack_bytes / depth);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+// Stages benchmark: time every stage of the compiler separately on generated
+// corpora (see corpus.h), and print the times as JSON, to compare versions.
+// Stages are lexing, parsing (lexing included), code generation without
+// optimization, optimization (function passes of -O2), and JIT compilation
+// of the optimized module to machine code. Times are medians of repetitions.
+//
+// usage: bench/stages [scale] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "llvm/Support/TargetSelect.h"
+#include "../src/jit/JIT.h"
+#include "../src/optimizer/Optimizer.h"
+#include "../src/parser/Parser.h"
+#include "../src/session/Session.h"
+#include "corpus.h"
+
+// stages, in order
+enum Stage { LEX, PARSE, CODEGEN, OPTIMIZE, JIT, STAGES };
+
+static const char *stage_names[STAGES] = { "lex", "parse", "codegen", "optimize", "jit" };
+
+struct Measure {
+    size_t tokens = 0;
+    size_t definitions = 0;
+    double milliseconds[STAGES] = {};
+};
+
+static llvm::ExitOnError exit_on_error;
+
+static double elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// run every stage on source once
+static Measure run(const std::string &source) {
+    Measure measure;
+    // lexing
+    {
+        session::CompilerSession session;
+        session.lexer.open_buffer(llvm::MemoryBuffer::getMemBuffer(source, "corpus", false));
+        auto start = std::chrono::steady_clock::now();
+        while (session.lexer.get_next_token() != lexer::Token::END_OF_FILE) {
+            measure.tokens++;
+        }
+        measure.milliseconds[LEX] = elapsed(start);
+    }
+    // parsing, without simplification (code generation must not optimize)
+    session::Options options;
+    options.optimization_level = 0;
+    session::CompilerSession session(options);
+    session.lexer.open_buffer(llvm::MemoryBuffer::getMemBuffer(source, "corpus", false));
+    std::vector<ast::Unit<ast::FunctionDefinition>> definitions;
+    auto start = std::chrono::steady_clock::now();
+    session.lexer.get_next_token();
+    while (session.lexer.current_token != lexer::Token::END_OF_FILE) {
+        if (session.lexer.current_token == ';') {
+            session.lexer.get_next_token();
+            continue;
+        }
+        definitions.push_back(parser::parse_function_definition(session));
+        if (!definitions.back()) {
+            break;
+        }
+    }
+    measure.milliseconds[PARSE] = elapsed(start);
+    measure.definitions = definitions.size();
+    // code generation
+    session.initialize_module("corpus");
+    start = std::chrono::steady_clock::now();
+    for (auto &definition : definitions) {
+        definition -> codegen(session);
+    }
+    measure.milliseconds[CODEGEN] = elapsed(start);
+    if (session.errors) {
+        fprintf(stderr, "error: corpus does not compile\n");
+        exit(1);
+    }
+    // optimization
+    optimizer::Optimizer optimizer(2);
+    optimizer.initialize(session.module.get());
+    start = std::chrono::steady_clock::now();
+    for (auto &function : *session.module) {
+        if (!function.isDeclaration()) {
+            optimizer.run(function);
+        }
+    }
+    measure.milliseconds[OPTIMIZE] = elapsed(start);
+    // JIT compilation, looking a function up compiles the whole module
+    auto jit = exit_on_error(jit::KaleidoscopeJIT::create());
+    std::string name = session.symbol_table.get_name(definitions.back() -> get_declaration() -> get_name()).str();
+    start = std::chrono::steady_clock::now();
+    exit_on_error(jit -> add_module(llvm::orc::ThreadSafeModule(std::move(session.module), std::move(session.context))));
+    exit_on_error(jit -> lookup(name));
+    measure.milliseconds[JIT] = elapsed(start);
+    return measure;
+}
+
+// median of every stage over repetitions runs
+static Measure run(const std::string &source, unsigned repetitions) {
+    std::vector<Measure> measures;
+    for (unsigned i = 0; i < repetitions; i++) {
+        measures.push_back(run(source));
+    }
+    Measure median = measures[0];
+    for (unsigned stage = 0; stage < STAGES; stage++) {
+        std::vector<double> times;
+        for (auto &measure : measures) {
+            times.push_back(measure.milliseconds[stage]);
+        }
+        std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+        median.milliseconds[stage] = times[times.size() / 2];
+    }
+    return median;
+}
+
+int main(int argc, char **argv) {
+    unsigned scale = argc > 1 ? atoi(argv[1]) : 1;
+    unsigned repetitions = argc > 2 ? atoi(argv[2]) : 5;
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    struct {
+        const char *name;
+        std::string source;
+    } corpora[] = {
+        { "deep", corpus::deep(200 * scale, 100) },
+        { "wide", corpus::wide(200 * scale, 64) },
+        { "many", corpus::many(2000 * scale) },
+    };
+    printf("{\n  \"benchmark\": \"stages\",\n  \"scale\": %u,\n  \"repetitions\": %u,\n  \"corpora\": [\n", scale, repetitions);
+    for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+        Measure measure = run(corpora[i].source, repetitions);
+        size_t bytes = corpora[i].source.size();
+        printf("    {\n      \"name\": \"%s\",\n      \"bytes\": %zu,\n      \"tokens\": %zu,\n      \"definitions\": %zu,\n",
+            corpora[i].name, bytes, measure.tokens, measure.definitions);
+        printf("      \"stages\": {\n");
+        for (unsigned stage = 0; stage < STAGES; stage++) {
+            double milliseconds = measure.milliseconds[stage];
+            printf("        \"%s\": { \"ms\": %.3f, \"mb_per_s\": %.2f }%s\n", stage_names[stage], milliseconds,
+                bytes / milliseconds / 1000, stage + 1 < STAGES ? "," : "");
+        }
+        printf("      }\n    }%s\n", i + 1 < sizeof(corpora) / sizeof(corpora[0]) ? "," : "");
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
@@ -1,117 +1,590 @@
 #include "AST.h"
-#include "../utils/Utils.h"
+#include "../session/Session.h"
 #include "../logger/Logger.h"
 #include "llvm/IR/BasicBlock.h"
 
-llvm::Value *ast::NumberLiteral::codegen() {
-    return llvm::ConstantFP::get(utils::context, llvm::APFloat(value));
+llvm::Value *ast::NumberLiteral::codegen(session::CompilerSession &session) {
+    return llvm::ConstantFP::get(session.get_value_type(), value);
 }
 
-llvm::Value *ast::VariableReference::codegen() {
-    llvm::Value *symbol = utils::symbols[variable];
-    if (!symbol) {
-        return logger::log_value_error("unknown variable name");
+// create stack slot for variable in the entry block of function, where mem2reg promotes it
+static llvm::AllocaInst *create_entry_block_alloca(session::CompilerSession &session,
+    llvm::Function *function, symbols::Symbol variable) {
+    llvm::IRBuilder<> builder(&function -> getEntryBlock(), function -> getEntryBlock().begin());
+    return builder.CreateAlloca(session.get_value_type(), nullptr, session.symbol_table.get_name(variable));
+}
+
+llvm::Value *ast::VariableReference::codegen(session::CompilerSession &session) {
+    llvm::AllocaInst *slot = session.scope.lookup(variable);
+    if (!slot) {
+        return logger::log_value_error(session, "unknown variable name");
+    }
+    return session.builder -> CreateLoad(slot -> getAllocatedType(), slot, session.symbol_table.get_name(variable));
+}
+
+// generate code for assignment variable = value, whose value is value
+static llvm::Value *codegen_assignment(session::CompilerSession &session, ast::Expression *variable, ast::Expression *value) {
+    auto *reference = llvm::dyn_cast<ast::VariableReference>(variable);
+    if (!reference) {
+        return logger::log_value_error(session, "destination of '=' must be a variable");
+    }
+    llvm::Value *assigned_value = value -> codegen(session);
+    if (!assigned_value) {
+        return nullptr;
+    }
+    llvm::AllocaInst *slot = session.scope.lookup(reference -> get_variable());
+    if (!slot) {
+        return logger::log_value_error(session, "unknown variable name");
+    }
+    session.builder -> CreateStore(assigned_value, slot);
+    return assigned_value;
+}
+
+// retrieve function from current module or declare it from its last declaration
+static llvm::Function *get_function(session::CompilerSession &session, symbols::Symbol name) {
+    // function already in current module
+    if (auto *function = session.module_functions.lookup(name)) {
+        return function;
+    }
+    // function declared before, re-declare it in current module
+    if (auto *declaration = session.function_declarations.lookup(name)) {
+        return declaration -> codegen(session);
+    }
+    // unknown function
+    return nullptr;
+}
+
+// call scalar function on every lane of vector argument values
+static llvm::Value *codegen_per_lane(session::CompilerSession &session, symbols::Symbol name,
+    llvm::ArrayRef<llvm::Value *> argument_values) {
+    // declare scalar function
+    llvm::Type *double_type = llvm::Type::getDoubleTy(*session.context);
+    std::vector<llvm::Type *> doubles(argument_values.size(), double_type);
+    llvm::FunctionCallee function = session.module -> getOrInsertFunction(
+        session.symbol_table.get_name(name), llvm::FunctionType::get(double_type, doubles, false));
+    // call function on every lane
+    llvm::Value *result = llvm::UndefValue::get(session.get_value_type());
+    llvm::SmallVector<llvm::Value *, 8> lane_values(argument_values.size());
+    for (unsigned lane = 0; lane < session.vector_width; lane++) {
+        for (size_t i = 0; i < argument_values.size(); i++) {
+            lane_values[i] = session.builder -> CreateExtractElement(argument_values[i], lane);
+        }
+        llvm::Value *lane_result = session.builder -> CreateCall(function, lane_values, "calltmp");
+        result = session.builder -> CreateInsertElement(result, lane_result, lane);
+    }
+    return result;
+}
+
+// call scalar function on every lane of vector arguments,
+// for functions without vector code (externs)
+static llvm::Value *codegen_call_per_lane(session::CompilerSession &session, const ast::FunctionCall &call) {
+    auto *declaration = session.function_declarations.lookup(call.get_callee());
+    if (!declaration) {
+        return logger::log_value_error(session, "unknown referenced function");
+    }
+    // check arguments
+    if (declaration -> get_arguments().size() != call.get_arguments().size()) {
+        return logger::log_value_error(session, "incorrect # of arguments");
+    }
+    // generate code for arguments
+    llvm::SmallVector<llvm::Value *, 8> argument_values;
+    for (auto *argument : call.get_arguments()) {
+        argument_values.push_back(argument -> codegen(session));
+        if (!argument_values.back()) {
+            return nullptr;
+        }
+    }
+    return codegen_per_lane(session, call.get_callee(), argument_values);
+}
+
+// generate code for a call of the function of an operator on its operand values
+// (functions of operators are always inlined, see FunctionDefinition::codegen)
+static llvm::Value *codegen_operator_call(session::CompilerSession &session, symbols::Symbol function,
+    llvm::ArrayRef<llvm::Value *> operand_values, const char *error) {
+    auto *declaration = session.function_declarations.lookup(function);
+    if (!declaration || declaration -> get_arguments().size() != operand_values.size()) {
+        return logger::log_value_error(session, error);
+    }
+    // no vector code for operators without definition
+    if (session.vector_width > 1 && !session.function_definitions.lookup(function)) {
+        return codegen_per_lane(session, function, operand_values);
     }
-    return symbol;
+    llvm::Function *callee_function = get_function(session, function);
+    return session.builder -> CreateCall(callee_function, operand_values, "optmp");
 }
 
-llvm::Value *ast::BinaryOperation::codegen() {
-    llvm::Value *lhs_value = lhs -> codegen();
-    llvm::Value *rhs_value = rhs -> codegen();
+llvm::Value *ast::BinaryOperation::codegen(session::CompilerSession &session) {
+    // assignment, whose left hand side is not evaluated
+    if (binary_operator == '=') {
+        return codegen_assignment(session, lhs, rhs);
+    }
+    llvm::Value *lhs_value = lhs -> codegen(session);
+    llvm::Value *rhs_value = rhs -> codegen(session);
     if (!lhs_value || !rhs_value) {
         return nullptr;
     }
     switch (binary_operator) {
         // addition
         case '+' :
-            return utils::builder.CreateFAdd(lhs_value, rhs_value, "addtmp");
+            return session.builder -> CreateFAdd(lhs_value, rhs_value, "addtmp");
         // subtraction
         case '-' :
-            return utils::builder.CreateFSub(lhs_value, rhs_value, "subtmp");
+            return session.builder -> CreateFSub(lhs_value, rhs_value, "subtmp");
         // multiplication
         case '*' :
-            return utils::builder.CreateFMul(lhs_value, rhs_value, "multmp");
+            return session.builder -> CreateFMul(lhs_value, rhs_value, "multmp");
         // comparison
         case '<' :
-            return utils::builder.CreateUIToFP(
-                utils::builder.CreateFCmpULT(lhs_value, rhs_value, "cmptmp"),
-                    llvm::Type::getDoubleTy(utils::context), "booltmp");
-        // unknown
+            return session.builder -> CreateUIToFP(
+                session.builder -> CreateFCmpULT(lhs_value, rhs_value, "cmptmp"),
+                    session.get_value_type(), "booltmp");
+        // defined by the input, or unknown
         default :
-            return logger::log_value_error("invalid binary operator");
+            llvm::Value *operand_values[] = { lhs_value, rhs_value };
+            return codegen_operator_call(session, session.get_operator_function("binary", binary_operator),
+                operand_values, "invalid binary operator");
+    }
+}
+
+llvm::Value *ast::UnaryOperation::codegen(session::CompilerSession &session) {
+    llvm::Value *operand_value = operand -> codegen(session);
+    if (!operand_value) {
+        return nullptr;
     }
+    return codegen_operator_call(session, session.get_operator_function("unary", unary_operator),
+        operand_value, "unknown unary operator");
 }
 
-llvm::Value *ast::FunctionCall::codegen() {
+llvm::Value *ast::FunctionCall::codegen(session::CompilerSession &session) {
+    // no vector code for functions without definition
+    if (session.vector_width > 1 && !session.function_definitions.lookup(callee)) {
+        return codegen_call_per_lane(session, *this);
+    }
     // retrieve function from module
-    llvm::Function *callee_function = utils::module -> getFunction(callee);
+    llvm::Function *callee_function = get_function(session, callee);
     if (!callee_function) {
-        return logger::log_value_error("unknown referenced function");
+        return logger::log_value_error(session, "unknown referenced function");
     }
     // check arguments
     if (callee_function -> arg_size() != arguments.size()) {
-        return logger::log_value_error("incorrect # of arguments");
+        return logger::log_value_error(session, "incorrect # of arguments");
     }
     // generate code for arguments
-    std::vector<llvm::Value *> argument_values;
-    for (int i = 0; i < arguments.size(); i++) {
-        argument_values.push_back(arguments[i] -> codegen());
+    llvm::SmallVector<llvm::Value *, 8> argument_values;
+    for (size_t i = 0; i < arguments.size(); i++) {
+        argument_values.push_back(arguments[i] -> codegen(session));
         if (!argument_values.back()) {
             return nullptr;
         }
     }
-    // generate code for function call
-    return utils::builder.CreateCall(callee_function, argument_values, "calltmp");
+    // generate code for function call, the caller's stack slots never escape
+    // so calls in tail position can reuse its frame (or become loops)
+    llvm::CallInst *call = session.builder -> CreateCall(callee_function, argument_values, "calltmp");
+    call -> setTailCall(tail);
+    return call;
+}
+
+// generate code for condition, true if neither 0 nor NaN
+static llvm::Value *codegen_condition(session::CompilerSession &session, ast::Expression *condition, const char *name) {
+    llvm::Value *value = condition -> codegen(session);
+    if (!value) {
+        return nullptr;
+    }
+    return session.builder -> CreateFCmpONE(value, llvm::ConstantFP::get(session.get_value_type(), 0.0), name);
+}
+
+llvm::Value *ast::IfExpression::codegen(session::CompilerSession &session) {
+    llvm::Value *condition_value = codegen_condition(session, condition, "ifcond");
+    if (!condition_value) {
+        return nullptr;
+    }
+    auto &builder = *session.builder;
+    llvm::Function *function = builder.GetInsertBlock() -> getParent();
+    // blocks of then, else and after them, appended in this order
+    llvm::BasicBlock *then_block = llvm::BasicBlock::Create(*session.context, "then", function);
+    llvm::BasicBlock *else_block = llvm::BasicBlock::Create(*session.context, "else");
+    llvm::BasicBlock *merge_block = llvm::BasicBlock::Create(*session.context, "ifcont");
+    builder.CreateCondBr(condition_value, then_block, else_block);
+    // then branch, its code may end in another block (e.g. of a nested if)
+    builder.SetInsertPoint(then_block);
+    llvm::Value *then_value = then_expression -> codegen(session);
+    if (!then_value) {
+        // leave blocks to the function, erased on errors
+        function -> getBasicBlockList().push_back(else_block);
+        function -> getBasicBlockList().push_back(merge_block);
+        return nullptr;
+    }
+    builder.CreateBr(merge_block);
+    then_block = builder.GetInsertBlock();
+    // else branch
+    function -> getBasicBlockList().push_back(else_block);
+    builder.SetInsertPoint(else_block);
+    llvm::Value *else_value = else_expression -> codegen(session);
+    if (!else_value) {
+        function -> getBasicBlockList().push_back(merge_block);
+        return nullptr;
+    }
+    builder.CreateBr(merge_block);
+    else_block = builder.GetInsertBlock();
+    // merge values of both branches
+    function -> getBasicBlockList().push_back(merge_block);
+    builder.SetInsertPoint(merge_block);
+    llvm::PHINode *value = builder.CreatePHI(session.get_value_type(), 2, "iftmp");
+    value -> addIncoming(then_value, then_block);
+    value -> addIncoming(else_value, else_block);
+    return value;
+}
+
+// The loop is generated rotated, as LLVM's loop passes expect it: the end
+// condition is checked once before the loop (its preheader branches over it)
+// and then at the bottom of the loop body. The variable lives in a stack
+// slot, as any variable, that mem2reg turns into a PHI node.
+llvm::Value *ast::ForExpression::codegen(session::CompilerSession &session) {
+    llvm::Value *start_value = start -> codegen(session);
+    if (!start_value) {
+        return nullptr;
+    }
+    auto &builder = *session.builder;
+    llvm::Function *function = builder.GetInsertBlock() -> getParent();
+    llvm::AllocaInst *slot = create_entry_block_alloca(session, function, variable);
+    builder.CreateStore(start_value, slot);
+    llvm::BasicBlock *loop_block = llvm::BasicBlock::Create(*session.context, "loop");
+    llvm::BasicBlock *after_block = llvm::BasicBlock::Create(*session.context, "afterloop");
+    // variable shadows any variable of the same name, within the loop
+    llvm::AllocaInst *shadowed_slot = session.scope.lookup(variable);
+    session.scope.set(variable, slot);
+    auto finish = [&]() {
+        function -> getBasicBlockList().push_back(after_block);
+        builder.SetInsertPoint(after_block);
+        session.scope.set(variable, shadowed_slot);
+    };
+    // check end condition on start value
+    llvm::Value *end_value = codegen_condition(session, end, "loopcond");
+    if (!end_value) {
+        // leave blocks to the function, erased on errors
+        function -> getBasicBlockList().push_back(loop_block);
+        finish();
+        return nullptr;
+    }
+    builder.CreateCondBr(end_value, loop_block, after_block);
+    // body, for the value of variable of the current iteration
+    function -> getBasicBlockList().push_back(loop_block);
+    builder.SetInsertPoint(loop_block);
+    if (!body -> codegen(session)) {
+        finish();
+        return nullptr;
+    }
+    // step variable (that body may have assigned)
+    llvm::Value *step_value = step ? step -> codegen(session) : llvm::ConstantFP::get(session.get_value_type(), 1.0);
+    if (!step_value) {
+        finish();
+        return nullptr;
+    }
+    llvm::Value *variable_value = builder.CreateLoad(slot -> getAllocatedType(), slot, session.symbol_table.get_name(variable));
+    builder.CreateStore(builder.CreateFAdd(variable_value, step_value, "nextvar"), slot);
+    // check end condition on next value, loop back while it holds
+    end_value = codegen_condition(session, end, "loopcond");
+    if (!end_value) {
+        finish();
+        return nullptr;
+    }
+    builder.CreateCondBr(end_value, loop_block, after_block);
+    // continue after loop, for expressions always evaluate to 0
+    finish();
+    return llvm::ConstantFP::get(session.get_value_type(), 0.0);
+}
+
+llvm::Value *ast::VarExpression::codegen(session::CompilerSession &session) {
+    llvm::Function *function = session.builder -> GetInsertBlock() -> getParent();
+    // define variables, in order, remembering those they shadow
+    llvm::SmallVector<llvm::AllocaInst *, 4> shadowed_slots;
+    auto restore_scope = [&]() {
+        for (size_t i = shadowed_slots.size(); i-- > 0; ) {
+            session.scope.set(variables[i].name, shadowed_slots[i]);
+        }
+    };
+    for (auto &variable : variables) {
+        // initializer does not see the variable it initializes
+        llvm::Value *initial_value = variable.initializer ? variable.initializer -> codegen(session)
+            : llvm::ConstantFP::get(session.get_value_type(), 0.0);
+        if (!initial_value) {
+            restore_scope();
+            return nullptr;
+        }
+        llvm::AllocaInst *slot = create_entry_block_alloca(session, function, variable.name);
+        session.builder -> CreateStore(initial_value, slot);
+        shadowed_slots.push_back(session.scope.lookup(variable.name));
+        session.scope.set(variable.name, slot);
+    }
+    llvm::Value *body_value = body -> codegen(session);
+    restore_scope();
+    return body_value;
+}
+
+// true if expression branches: the lanes of its vector code would have
+// to take different paths, so vector code runs the scalar code lane by lane
+static bool has_control_flow(ast::Expression *expression) {
+    if (llvm::isa<ast::IfExpression>(expression) || llvm::isa<ast::ForExpression>(expression)) {
+        return true;
+    }
+    if (auto *operation = llvm::dyn_cast<ast::BinaryOperation>(expression)) {
+        return has_control_flow(operation -> get_lhs()) || has_control_flow(operation -> get_rhs());
+    }
+    if (auto *operation = llvm::dyn_cast<ast::UnaryOperation>(expression)) {
+        return has_control_flow(operation -> get_operand());
+    }
+    if (auto *call = llvm::dyn_cast<ast::FunctionCall>(expression)) {
+        return llvm::any_of(call -> get_arguments(), has_control_flow);
+    }
+    if (auto *var = llvm::dyn_cast<ast::VarExpression>(expression)) {
+        return has_control_flow(var -> get_body()) || llvm::any_of(var -> get_variables(),
+            [](const ast::VariableDefinition &variable) {
+                return variable.initializer && has_control_flow(variable.initializer);
+            });
+    }
+    return false;
+}
+
+// mark the calls whose value expression evaluates to as is (the branches
+// of ifs, the bodies of vars): nothing is left to do after them
+static void mark_tail_calls(ast::Expression *expression) {
+    if (auto *call = llvm::dyn_cast<ast::FunctionCall>(expression)) {
+        call -> set_tail();
+    } else if (auto *if_expression = llvm::dyn_cast<ast::IfExpression>(expression)) {
+        mark_tail_calls(if_expression -> get_then());
+        mark_tail_calls(if_expression -> get_else());
+    } else if (auto *var = llvm::dyn_cast<ast::VarExpression>(expression)) {
+        mark_tail_calls(var -> get_body());
+    }
+}
+
+// collect the functions of the operators defined by the input that expression applies
+static void collect_operator_functions(session::CompilerSession &session, ast::Expression *expression,
+    llvm::SmallVectorImpl<symbols::Symbol> &functions) {
+    if (auto *operation = llvm::dyn_cast<ast::BinaryOperation>(expression)) {
+        char binary_operator = operation -> get_operator();
+        if (session::BUILTIN_BINARY_OPERATOR_PRECEDENCES[(unsigned char) binary_operator] < 0) {
+            functions.push_back(session.get_operator_function("binary", binary_operator));
+        }
+        collect_operator_functions(session, operation -> get_lhs(), functions);
+        collect_operator_functions(session, operation -> get_rhs(), functions);
+    } else if (auto *operation = llvm::dyn_cast<ast::UnaryOperation>(expression)) {
+        functions.push_back(session.get_operator_function("unary", operation -> get_operator()));
+        collect_operator_functions(session, operation -> get_operand(), functions);
+    } else if (auto *call = llvm::dyn_cast<ast::FunctionCall>(expression)) {
+        for (auto *argument : call -> get_arguments()) {
+            collect_operator_functions(session, argument, functions);
+        }
+    } else if (auto *if_expression = llvm::dyn_cast<ast::IfExpression>(expression)) {
+        collect_operator_functions(session, if_expression -> get_condition(), functions);
+        collect_operator_functions(session, if_expression -> get_then(), functions);
+        collect_operator_functions(session, if_expression -> get_else(), functions);
+    } else if (auto *for_expression = llvm::dyn_cast<ast::ForExpression>(expression)) {
+        collect_operator_functions(session, for_expression -> get_start(), functions);
+        collect_operator_functions(session, for_expression -> get_end(), functions);
+        if (for_expression -> get_step()) {
+            collect_operator_functions(session, for_expression -> get_step(), functions);
+        }
+        collect_operator_functions(session, for_expression -> get_body(), functions);
+    } else if (auto *var = llvm::dyn_cast<ast::VarExpression>(expression)) {
+        for (auto &variable : var -> get_variables()) {
+            if (variable.initializer) {
+                collect_operator_functions(session, variable.initializer, functions);
+            }
+        }
+        collect_operator_functions(session, var -> get_body(), functions);
+    }
+}
+
+// report the first error code generation would about the functions expression
+// calls (unknown, or with another number of arguments), where definition is
+// the declaration of the function being defined; return false if any
+static bool check_calls(session::CompilerSession &session, const ast::FunctionDeclaration &definition,
+    ast::Expression *expression) {
+    // declaration of function: the one being defined, or its most recent one
+    auto lookup = [&](symbols::Symbol function) -> const ast::FunctionDeclaration * {
+        return function == definition.get_name() ? &definition : session.function_declarations.lookup(function);
+    };
+    // operands first, as code generation
+    auto check_operator = [&](symbols::Symbol function, size_t operands, const char *error) {
+        auto *declaration = lookup(function);
+        if (!declaration || declaration -> get_arguments().size() != operands) {
+            logger::log_value_error(session, error);
+            return false;
+        }
+        return true;
+    };
+    if (auto *operation = llvm::dyn_cast<ast::BinaryOperation>(expression)) {
+        if (!check_calls(session, definition, operation -> get_lhs()) || !check_calls(session, definition, operation -> get_rhs())) {
+            return false;
+        }
+        char binary_operator = operation -> get_operator();
+        return session::BUILTIN_BINARY_OPERATOR_PRECEDENCES[(unsigned char) binary_operator] >= 0
+            || check_operator(session.get_operator_function("binary", binary_operator), 2, "invalid binary operator");
+    }
+    if (auto *operation = llvm::dyn_cast<ast::UnaryOperation>(expression)) {
+        return check_calls(session, definition, operation -> get_operand())
+            && check_operator(session.get_operator_function("unary", operation -> get_operator()), 1, "unknown unary operator");
+    }
+    if (auto *call = llvm::dyn_cast<ast::FunctionCall>(expression)) {
+        // callee first, then arguments, as code generation
+        auto *declaration = lookup(call -> get_callee());
+        if (!declaration) {
+            logger::log_value_error(session, "unknown referenced function");
+            return false;
+        }
+        if (declaration -> get_arguments().size() != call -> get_arguments().size()) {
+            logger::log_value_error(session, "incorrect # of arguments");
+            return false;
+        }
+        for (auto *argument : call -> get_arguments()) {
+            if (!check_calls(session, definition, argument)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (auto *if_expression = llvm::dyn_cast<ast::IfExpression>(expression)) {
+        return check_calls(session, definition, if_expression -> get_condition())
+            && check_calls(session, definition, if_expression -> get_then())
+            && check_calls(session, definition, if_expression -> get_else());
+    }
+    if (auto *for_expression = llvm::dyn_cast<ast::ForExpression>(expression)) {
+        return check_calls(session, definition, for_expression -> get_start())
+            && check_calls(session, definition, for_expression -> get_end())
+            && (!for_expression -> get_step() || check_calls(session, definition, for_expression -> get_step()))
+            && check_calls(session, definition, for_expression -> get_body());
+    }
+    if (auto *var = llvm::dyn_cast<ast::VarExpression>(expression)) {
+        for (auto &variable : var -> get_variables()) {
+            if (variable.initializer && !check_calls(session, definition, variable.initializer)) {
+                return false;
+            }
+        }
+        return check_calls(session, definition, var -> get_body());
+    }
+    return true;
 }
 
-llvm::Function *ast::FunctionDeclaration::codegen() {
-    // create vector of arguments.size double values
-    std::vector<llvm::Type *> doubles(arguments.size(), llvm::Type::getDoubleTy(utils::context));
+bool ast::FunctionDefinition::check_calls(session::CompilerSession &session) const {
+    return ::check_calls(session, *declaration, body);
+}
+
+llvm::Function *ast::FunctionDeclaration::codegen(session::CompilerSession &session) {
+    // create vector of arguments.size double values (or vectors of doubles)
+    std::vector<llvm::Type *> doubles(arguments.size(), session.get_value_type());
     // create function return type (always double in kaleidoscope)
-    llvm::FunctionType *function_type = llvm::FunctionType::get(llvm::Type::getDoubleTy(utils::context), doubles, false);
+    llvm::FunctionType *function_type = llvm::FunctionType::get(session.get_value_type(), doubles, false);
     // create function
-    llvm::Function *function = llvm::Function::Create(function_type, llvm::Function::ExternalLinkage, name, utils::module.get());
+    llvm::Function *function = llvm::Function::Create(function_type, llvm::Function::ExternalLinkage,
+        session.get_function_name(name), session.module.get());
+    session.module_functions.set(name, function);
+    // operators cost no call, as the built-in ones
+    if (operator_function) {
+        function -> addFnAttr(llvm::Attribute::AlwaysInline);
+    }
     // set names for all arguments
     unsigned index = 0;
     for (auto &argument : function -> args()) {
-        argument.setName(arguments[index++]);
+        argument.setName(session.symbol_table.get_name(arguments[index++]));
     }
     // return function declaration
     return function;
-} 
+}
 
-llvm::Function *ast::FunctionDefinition::codegen() {
-    // retrieve function declaration from previous externs
-    llvm::Function *function_definition = utils::module -> getFunction(declaration -> get_name());
-    // generate code for function declaration (if not done yet)
-    if (!function_definition) {
-        function_definition = declaration -> codegen();
+ast::FunctionDeclaration *ast::FunctionDeclaration::clone(Arena &arena) const {
+    return arena.make<FunctionDeclaration>(name, arena.copy(arguments), operator_function, precedence);
+}
+
+llvm::Function *ast::FunctionDefinition::codegen(session::CompilerSession &session) {
+    // error if declared before with a different number of arguments:
+    // functions can be redefined, but their callers must stay valid
+    auto *previous_declaration = session.function_declarations.lookup(declaration -> get_name());
+    if (previous_declaration && previous_declaration -> get_arguments().size() != declaration -> get_arguments().size()) {
+        return (llvm::Function *) logger::log_value_error(session, "Function redeclared with a different number of arguments.");
+    }
+    // generate the operators body applies, if defined in other modules, for the
+    // optimizer to inline them: available externally, their code is not emitted.
+    // The definition cannot be generated without them (an operator's own one is
+    // in this module, and recursive).
+    llvm::SmallVector<symbols::Symbol, 8> operator_functions;
+    collect_operator_functions(session, body, operator_functions);
+    for (symbols::Symbol operator_function : operator_functions) {
+        auto definition = session.function_definitions.lookup(operator_function);
+        if (!definition || operator_function == declaration -> get_name() || session.module_functions.lookup(operator_function)) {
+            continue;
+        }
+        llvm::Function *copy = definition -> codegen(session);
+        if (!copy) {
+            return nullptr;
+        }
+        copy -> setLinkage(llvm::Function::AvailableExternallyLinkage);
     }
+    // record function declaration, so that later modules can call it
+    session.declare_function(*declaration);
+    // retrieve function declaration, generate code for it if not done yet
+    llvm::Function *function_definition = get_function(session, declaration -> get_name());
     // error if null
     if (!function_definition) {
         return nullptr;
     }
     // error function redefinition
     if (!function_definition -> empty()) {
-        return (llvm::Function *) logger::log_value_error("Function cannot be redefined.");
+        return (llvm::Function *) logger::log_value_error(session, "Function cannot be redefined.");
+    }
+    // error if declared before with a different number of arguments
+    if (function_definition -> arg_size() != declaration -> get_arguments().size()) {
+        return (llvm::Function *) logger::log_value_error(session, "Function redeclared with a different number of arguments.");
     }
     // create new basic block for function body
-    llvm::BasicBlock *function_body = llvm::BasicBlock::Create(utils::context, "entry", function_definition);
+    llvm::BasicBlock *function_body = llvm::BasicBlock::Create(*session.context, "entry", function_definition);
     // move builder to function body
-    utils::builder.SetInsertPoint(function_body);
-    // clear symbols
-    utils::symbols.clear();
-    // add arguments to symbols
+    session.builder -> SetInsertPoint(function_body);
+    // clear scope
+    session.scope.clear();
+    // add arguments to scope, in stack slots so that they can be assigned
+    unsigned index = 0;
     for (auto &function_argument : function_definition -> args()) {
-        utils::symbols[function_argument.getName()] = &function_argument;
+        symbols::Symbol argument = declaration -> get_arguments()[index++];
+        llvm::AllocaInst *slot = create_entry_block_alloca(session, function_definition, argument);
+        session.builder -> CreateStore(&function_argument, slot);
+        session.scope.set(argument, slot);
+    }
+    // generate code from body (or call the scalar code per lane), set return value and check
+    llvm::Value *function_return_value;
+    if (session.vector_width > 1 && has_control_flow(body)) {
+        llvm::SmallVector<llvm::Value *, 8> argument_values;
+        for (auto &function_argument : function_definition -> args()) {
+            argument_values.push_back(&function_argument);
+        }
+        function_return_value = codegen_per_lane(session, declaration -> get_name(), argument_values);
+    } else {
+        mark_tail_calls(body);
+        function_return_value = body -> codegen(session);
     }
-    // generate code from body, set return value and check
-    if (llvm::Value *function_return_value = body -> codegen()) {
-        utils::builder.CreateRet(function_return_value);
-        llvm::verifyFunction(*function_definition);
+    if (function_return_value) {
+        llvm::ReturnInst *return_instruction = session.builder -> CreateRet(function_return_value);
+        // a call returned right away to a function of the same type must be
+        // a tail call: its frame replaces the caller's, even at -O0
+        auto *call = llvm::dyn_cast<llvm::CallInst>(function_return_value);
+        if (call && call -> getNextNode() == return_instruction
+            && call -> getFunctionType() == function_definition -> getFunctionType()) {
+            call -> setTailCallKind(llvm::CallInst::TCK_MustTail);
+        }
+        session.statistics.ir_instructions += function_definition -> getInstructionCount();
+        {
+            profiler::Scope scope(session.profiler.get(), profiler::VERIFY, function_definition -> getName());
+            llvm::verifyFunction(*function_definition);
+        }
+        {
+            profiler::Scope scope(session.profiler.get(), profiler::OPTIMIZE, function_definition -> getName());
+            session.optimizer.run(*function_definition);
+        }
         return function_definition;
     }
-    // error, remove function from module
+    // error, remove function from module and restore previous declaration
+    session.module_functions.set(declaration -> get_name(), nullptr);
+    session.function_declarations.set(declaration -> get_name(), previous_declaration);
     function_definition -> eraseFromParent();
     return nullptr;
 }
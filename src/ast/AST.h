@@ -1,17 +1,94 @@
 #ifndef __AST_H__
 #define __AST_H__
 
+#include <memory>
 #include <string>
-#include <vector>
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
 #include "llvm/IR/Value.h"
 #include "llvm/IR/Function.h"
+#include "llvm/Support/Allocator.h"
+#include "../symbols/Symbols.h"
+
+namespace session {
+    class CompilerSession;
+}
 
 namespace ast {
 
+    // Arena owns every node of a top level item.
+    // Nodes are bump-allocated and never destroyed one by one:
+    // the whole arena is freed at once. Therefore nodes only hold
+    // trivially destructible members (pointers, symbols, ArrayRef).
+    // Names are interned as symbols by the lexer, nodes hold those.
+    class Arena {
+
+        llvm::BumpPtrAllocator allocator;
+        unsigned nodes = 0;
+
+        public:
+            // allocate node in arena
+            template <typename T, typename... Arguments>
+            T *make(Arguments &&... arguments) {
+                nodes++;
+                return new (allocator.Allocate<T>()) T(std::forward<Arguments>(arguments)...);
+            }
+            // copy items into arena
+            template <typename T>
+            llvm::ArrayRef<T> copy(llvm::ArrayRef<T> items) {
+                T *copies = allocator.Allocate<T>(items.size());
+                std::uninitialized_copy(items.begin(), items.end(), copies);
+                return llvm::ArrayRef<T>(copies, items.size());
+            }
+            size_t get_bytes_allocated() const { return allocator.getBytesAllocated(); }
+            unsigned get_node_count() const { return nodes; }
+
+    };
+
+    // Unit is a parsed top level item together with the arena owning it.
+    // Copies share the arena, so that the item can be kept around.
+    template <typename T>
+    class Unit {
+
+        std::shared_ptr<Arena> arena;
+        T *root;
+
+        public:
+            Unit(std::shared_ptr<Arena> arena = nullptr, T *root = nullptr)
+                : arena(std::move(arena)), root(root) {}
+            explicit operator bool() const { return root; }
+            T *operator->() const { return root; }
+            T &operator*() const { return *root; }
+            T *get() const { return root; }
+            Arena &get_arena() const { return *arena; }
+
+    };
+
+    class Simplifier;
+
     class Expression {
         public:
+            // kind of expression, for isa<>/dyn_cast<>
+            enum Kind {
+                NUMBER_LITERAL,
+                VARIABLE_REFERENCE,
+                FUNCTION_CALL,
+                BINARY_OPERATION,
+                UNARY_OPERATION,
+                IF_EXPRESSION,
+                FOR_EXPRESSION,
+                VAR_EXPRESSION,
+            };
+        private:
+            const Kind kind;
+        public:
+            Expression(Kind kind)
+                : kind(kind) {}
             virtual ~Expression() {}
-            virtual llvm::Value *codegen() = 0;
+            Kind get_kind() const { return kind; }
+            virtual llvm::Value *codegen(session::CompilerSession &session) = 0;
+            // return an equivalent, simpler expression (possibly this one)
+            virtual Expression *simplify(Simplifier &simplifier) = 0;
     };
 
     class NumberLiteral : public Expression {
@@ -20,71 +97,193 @@ namespace ast {
 
         public:
             NumberLiteral(double value) 
-                : value(value) {}
-            virtual llvm::Value *codegen();
+                : Expression(NUMBER_LITERAL), value(value) {}
+            virtual llvm::Value *codegen(session::CompilerSession &session);
+            virtual Expression *simplify(Simplifier &simplifier);
+            double get_value() const { return value; }
+            static bool classof(const Expression *expression) { return expression -> get_kind() == NUMBER_LITERAL; }
     };
 
     class VariableReference : public Expression {
 
-        std::string variable;
+        symbols::Symbol variable;
 
         public:
-            VariableReference(std::string variable) 
-                : variable(variable) {}
-            virtual llvm::Value *codegen();
+            VariableReference(symbols::Symbol variable) 
+                : Expression(VARIABLE_REFERENCE), variable(variable) {}
+            virtual llvm::Value *codegen(session::CompilerSession &session);
+            virtual Expression *simplify(Simplifier &simplifier);
+            symbols::Symbol get_variable() const { return variable; }
+            static bool classof(const Expression *expression) { return expression -> get_kind() == VARIABLE_REFERENCE; }
 
     };
 
     class FunctionCall : public Expression {
 
-        std::string callee;
-        std::vector<std::unique_ptr<Expression>> arguments;
+        symbols::Symbol callee;
+        llvm::ArrayRef<Expression *> arguments;
+        // the function returns the value of the call as is
+        bool tail = false;
 
         public:
-            FunctionCall(std::string callee, std::vector<std::unique_ptr<Expression>> arguments) 
-                : callee(callee), arguments(std::move(arguments)) {}
-            virtual llvm::Value *codegen();  
+            FunctionCall(symbols::Symbol callee, llvm::ArrayRef<Expression *> arguments) 
+                : Expression(FUNCTION_CALL), callee(callee), arguments(arguments) {}
+            virtual llvm::Value *codegen(session::CompilerSession &session);  
+            virtual Expression *simplify(Simplifier &simplifier);
+            symbols::Symbol get_callee() const { return callee; }
+            llvm::ArrayRef<Expression *> get_arguments() const { return arguments; }
+            // mark call as in tail position, so that it is generated as a tail call
+            void set_tail() { tail = true; }
+            bool is_tail() const { return tail; }
+            static bool classof(const Expression *expression) { return expression -> get_kind() == FUNCTION_CALL; }
 
     };
 
     class BinaryOperation : public Expression {
         
         char binary_operator;
-        std::unique_ptr<Expression> lhs, rhs;
+        Expression *lhs, *rhs;
+
+        public:
+            BinaryOperation(char binary_operator, Expression *lhs, Expression *rhs)
+                : Expression(BINARY_OPERATION), binary_operator(binary_operator), lhs(lhs), rhs(rhs) {}
+            virtual llvm::Value *codegen(session::CompilerSession &session);
+            virtual Expression *simplify(Simplifier &simplifier);
+            char get_operator() const { return binary_operator; }
+            Expression *get_lhs() const { return lhs; }
+            Expression *get_rhs() const { return rhs; }
+            static bool classof(const Expression *expression) { return expression -> get_kind() == BINARY_OPERATION; }
+
+    };
+
+    // operator defined by the input applied to operand: a call
+    // of its function (e.g. unary! for !), inlined into the caller
+    class UnaryOperation : public Expression {
+
+        char unary_operator;
+        Expression *operand;
+
+        public:
+            UnaryOperation(char unary_operator, Expression *operand)
+                : Expression(UNARY_OPERATION), unary_operator(unary_operator), operand(operand) {}
+            virtual llvm::Value *codegen(session::CompilerSession &session);
+            virtual Expression *simplify(Simplifier &simplifier);
+            char get_operator() const { return unary_operator; }
+            Expression *get_operand() const { return operand; }
+            static bool classof(const Expression *expression) { return expression -> get_kind() == UNARY_OPERATION; }
+
+    };
+
+    // if condition then ... else ..., the value of the branch taken:
+    // then if condition is neither 0 nor NaN, else otherwise
+    class IfExpression : public Expression {
+
+        Expression *condition, *then_expression, *else_expression;
+
+        public:
+            IfExpression(Expression *condition, Expression *then_expression, Expression *else_expression)
+                : Expression(IF_EXPRESSION), condition(condition),
+                  then_expression(then_expression), else_expression(else_expression) {}
+            virtual llvm::Value *codegen(session::CompilerSession &session);
+            virtual Expression *simplify(Simplifier &simplifier);
+            Expression *get_condition() const { return condition; }
+            Expression *get_then() const { return then_expression; }
+            Expression *get_else() const { return else_expression; }
+            static bool classof(const Expression *expression) { return expression -> get_kind() == IF_EXPRESSION; }
+
+    };
+
+    // for variable = start, end, step in body: runs body for variable = start,
+    // start + step, ... as long as end (a condition on variable) holds, checked
+    // before every run as in C. The step is 1 if omitted, the value always 0.
+    class ForExpression : public Expression {
+
+        symbols::Symbol variable;
+        Expression *start, *end, *step, *body;
+
+        public:
+            ForExpression(symbols::Symbol variable, Expression *start, Expression *end, Expression *step, Expression *body)
+                : Expression(FOR_EXPRESSION), variable(variable), start(start), end(end), step(step), body(body) {}
+            virtual llvm::Value *codegen(session::CompilerSession &session);
+            virtual Expression *simplify(Simplifier &simplifier);
+            symbols::Symbol get_variable() const { return variable; }
+            Expression *get_start() const { return start; }
+            Expression *get_end() const { return end; }
+            // null if omitted
+            Expression *get_step() const { return step; }
+            Expression *get_body() const { return body; }
+            static bool classof(const Expression *expression) { return expression -> get_kind() == FOR_EXPRESSION; }
+
+    };
+
+    // variable of a var expression, initialized to 0 if no initializer
+    struct VariableDefinition {
+        symbols::Symbol name;
+        Expression *initializer;
+    };
+
+    // var name = initializer, ... in body: the value of body, where the
+    // variables are defined (they shadow variables of the same names).
+    // Initializers see the variables defined before them, not their own.
+    class VarExpression : public Expression {
+
+        llvm::ArrayRef<VariableDefinition> variables;
+        Expression *body;
 
         public:
-            BinaryOperation(char binary_operator, std::unique_ptr<Expression> lhs, std::unique_ptr<Expression> rhs)
-                : binary_operator(binary_operator), lhs(std::move(lhs)), rhs(std::move(rhs)) {}
-            virtual llvm::Value *codegen();
+            VarExpression(llvm::ArrayRef<VariableDefinition> variables, Expression *body)
+                : Expression(VAR_EXPRESSION), variables(variables), body(body) {}
+            virtual llvm::Value *codegen(session::CompilerSession &session);
+            virtual Expression *simplify(Simplifier &simplifier);
+            llvm::ArrayRef<VariableDefinition> get_variables() const { return variables; }
+            Expression *get_body() const { return body; }
+            static bool classof(const Expression *expression) { return expression -> get_kind() == VAR_EXPRESSION; }
 
     };
 
-    // function declaration
+    // function declaration, possibly of the function of an operator
+    // (e.g. binary| or unary!, named after the operator character)
     class FunctionDeclaration {
 
-        std::string name;
-        std::vector<std::string> arguments;
+        symbols::Symbol name;
+        llvm::ArrayRef<symbols::Symbol> arguments;
+        bool operator_function;
+        // precedence of a binary operator, 0 otherwise
+        int precedence;
 
         public:
-            FunctionDeclaration(const std::string name, std::vector<std::string> arguments)
-                : name(name), arguments(std::move(arguments)) {}
-            virtual llvm::Function *codegen();
-            const std::string &get_name() const { return name; }
+            FunctionDeclaration(symbols::Symbol name, llvm::ArrayRef<symbols::Symbol> arguments,
+                                bool operator_function = false, int precedence = 0)
+                : name(name), arguments(arguments), operator_function(operator_function), precedence(precedence) {}
+            virtual llvm::Function *codegen(session::CompilerSession &session);
+            symbols::Symbol get_name() const { return name; }
+            llvm::ArrayRef<symbols::Symbol> get_arguments() const { return arguments; }
+            bool is_operator() const { return operator_function; }
+            int get_precedence() const { return precedence; }
+            // copy declaration into arena, e.g. to outlive its top level item
+            FunctionDeclaration *clone(Arena &arena) const;
     };
 
     // function definition
     class FunctionDefinition {
         
-        std::unique_ptr<FunctionDeclaration> declaration;
-        std::unique_ptr<Expression> body;
+        FunctionDeclaration *declaration;
+        Expression *body;
 
         public:
-            FunctionDefinition(std::unique_ptr<FunctionDeclaration> declaration, std::unique_ptr<Expression> body)
-                : declaration(std::move(declaration)), body(std::move(body)) {}
-            virtual llvm::Function *codegen();
+            FunctionDefinition(FunctionDeclaration *declaration, Expression *body)
+                : declaration(declaration), body(body) {}
+            virtual llvm::Function *codegen(session::CompilerSession &session);
+            // simplify body
+            void simplify(Simplifier &simplifier);
+            // report the errors code generation would about the functions body calls,
+            // without generating code (e.g. for code compiled before): false if any
+            bool check_calls(session::CompilerSession &session) const;
+            FunctionDeclaration *get_declaration() const { return declaration; }
+            Expression *get_body() const { return body; }
 
     };
 
 }
 
-#endif
\ No newline at end of file
+#endif
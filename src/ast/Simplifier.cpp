@@ -0,0 +1,244 @@
+#include "Simplifier.h"
+#include <cmath>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Casting.h"
+
+// number of nodes of expression, 0 if it calls a function: calls
+// may have side effects, so such an expression can never be removed
+static unsigned count_removable_nodes(ast::Expression *expression) {
+    if (auto *operation = llvm::dyn_cast<ast::BinaryOperation>(expression)) {
+        char binary_operator = operation -> get_operator();
+        // assignments change variables, operators defined by the input are calls
+        if (binary_operator != '+' && binary_operator != '-' && binary_operator != '*' && binary_operator != '<') {
+            return 0;
+        }
+        unsigned lhs = count_removable_nodes(operation -> get_lhs());
+        unsigned rhs = count_removable_nodes(operation -> get_rhs());
+        return lhs && rhs ? lhs + rhs + 1 : 0;
+    }
+    if (auto *if_expression = llvm::dyn_cast<ast::IfExpression>(expression)) {
+        unsigned condition = count_removable_nodes(if_expression -> get_condition());
+        unsigned then_nodes = count_removable_nodes(if_expression -> get_then());
+        unsigned else_nodes = count_removable_nodes(if_expression -> get_else());
+        return condition && then_nodes && else_nodes ? condition + then_nodes + else_nodes + 1 : 0;
+    }
+    // loops may not terminate, variables may be initialized by calls
+    if (llvm::isa<ast::ForExpression>(expression) || llvm::isa<ast::VarExpression>(expression)) {
+        return 0;
+    }
+    // unary operators are all defined by the input, calls too
+    return llvm::isa<ast::FunctionCall>(expression) || llvm::isa<ast::UnaryOperation>(expression) ? 0 : 1;
+}
+
+// number of nodes of expression, calls included
+static unsigned count_nodes(ast::Expression *expression) {
+    if (!expression) {
+        return 0;
+    }
+    if (auto *call = llvm::dyn_cast<ast::FunctionCall>(expression)) {
+        unsigned nodes = 1;
+        for (auto *argument : call -> get_arguments()) {
+            nodes += count_nodes(argument);
+        }
+        return nodes;
+    }
+    if (auto *operation = llvm::dyn_cast<ast::BinaryOperation>(expression)) {
+        return count_nodes(operation -> get_lhs()) + count_nodes(operation -> get_rhs()) + 1;
+    }
+    if (auto *operation = llvm::dyn_cast<ast::UnaryOperation>(expression)) {
+        return count_nodes(operation -> get_operand()) + 1;
+    }
+    if (auto *if_expression = llvm::dyn_cast<ast::IfExpression>(expression)) {
+        return count_nodes(if_expression -> get_condition()) + count_nodes(if_expression -> get_then())
+            + count_nodes(if_expression -> get_else()) + 1;
+    }
+    if (auto *for_expression = llvm::dyn_cast<ast::ForExpression>(expression)) {
+        return count_nodes(for_expression -> get_start()) + count_nodes(for_expression -> get_end())
+            + count_nodes(for_expression -> get_step()) + count_nodes(for_expression -> get_body()) + 1;
+    }
+    if (auto *var_expression = llvm::dyn_cast<ast::VarExpression>(expression)) {
+        unsigned nodes = count_nodes(var_expression -> get_body()) + 1;
+        for (auto &variable : var_expression -> get_variables()) {
+            nodes += count_nodes(variable.initializer);
+        }
+        return nodes;
+    }
+    return 1;
+}
+
+// true if expression is the literal value (-0 and +0 are told apart)
+static bool is_literal(ast::Expression *expression, double value) {
+    auto *literal = llvm::dyn_cast<ast::NumberLiteral>(expression);
+    return literal && literal -> get_value() == value
+        && std::signbit(literal -> get_value()) == std::signbit(value);
+}
+
+// evaluate operator on constants, as the generated code would
+static double fold(char binary_operator, double lhs, double rhs) {
+    switch (binary_operator) {
+        case '+' :
+            return lhs + rhs;
+        case '-' :
+            return lhs - rhs;
+        case '*' :
+            return lhs * rhs;
+        // unordered or less than, as fcmp ult
+        case '<' :
+        default :
+            return !(lhs >= rhs) ? 1.0 : 0.0;
+    }
+}
+
+ast::Expression *ast::Simplifier::simplify_operation(BinaryOperation *operation, Expression *lhs, Expression *rhs) {
+    char binary_operator = operation -> get_operator();
+    // assignment, only its value can be simplified
+    if (binary_operator == '=') {
+        return rhs == operation -> get_rhs() ? operation : arena.make<BinaryOperation>(binary_operator, operation -> get_lhs(), rhs);
+    }
+    // operator defined by the input (or unknown, left for code generation to report)
+    if (binary_operator != '+' && binary_operator != '-' && binary_operator != '*' && binary_operator != '<') {
+        return lhs == operation -> get_lhs() && rhs == operation -> get_rhs() ? operation
+            : arena.make<BinaryOperation>(binary_operator, lhs, rhs);
+    }
+    auto *lhs_literal = llvm::dyn_cast<NumberLiteral>(lhs);
+    auto *rhs_literal = llvm::dyn_cast<NumberLiteral>(rhs);
+    // constant operands - fold (always exact, constants are IEEE doubles)
+    if (lhs_literal && rhs_literal) {
+        removed_nodes += 2;
+        return arena.make<NumberLiteral>(fold(binary_operator, lhs_literal -> get_value(), rhs_literal -> get_value()));
+    }
+    // x * 1, 1 * x -> x
+    if (binary_operator == '*' && (is_literal(rhs, 1.0) || is_literal(lhs, 1.0))) {
+        removed_nodes += 2;
+        return is_literal(rhs, 1.0) ? lhs : rhs;
+    }
+    // x + -0, -0 + x, x - 0 -> x
+    if ((binary_operator == '+' && is_literal(rhs, -0.0)) || (binary_operator == '-' && is_literal(rhs, 0.0))) {
+        removed_nodes += 2;
+        return lhs;
+    }
+    if (binary_operator == '+' && is_literal(lhs, -0.0)) {
+        removed_nodes += 2;
+        return rhs;
+    }
+    // x + 0, 0 + x -> x (-0 + 0 is +0)
+    if (options.no_signed_zeros && binary_operator == '+' && (is_literal(rhs, 0.0) || is_literal(lhs, 0.0))) {
+        removed_nodes += 2;
+        return is_literal(rhs, 0.0) ? lhs : rhs;
+    }
+    // x * 0, 0 * x -> 0 (NaN * 0 is NaN, inf * 0 is NaN, -1 * 0 is -0)
+    if (options.no_nans && options.no_infs && options.no_signed_zeros && binary_operator == '*') {
+        Expression *other = rhs_literal && rhs_literal -> get_value() == 0.0 ? lhs
+            : lhs_literal && lhs_literal -> get_value() == 0.0 ? rhs : nullptr;
+        if (unsigned nodes = other ? count_removable_nodes(other) : 0) {
+            removed_nodes += nodes + 1;
+            return arena.make<NumberLiteral>(0.0);
+        }
+    }
+    // (x + c1) + c2 -> x + (c1 + c2), (x * c1) * c2 -> x * (c1 * c2)
+    if (options.reassociate && rhs_literal && (binary_operator == '+' || binary_operator == '*')) {
+        auto *inner = llvm::dyn_cast<BinaryOperation>(lhs);
+        if (inner && inner -> get_operator() == binary_operator) {
+            if (auto *inner_literal = llvm::dyn_cast<NumberLiteral>(inner -> get_rhs())) {
+                double value = fold(binary_operator, inner_literal -> get_value(), rhs_literal -> get_value());
+                removed_nodes += 2;
+                return simplify_operation(operation, inner -> get_lhs(), arena.make<NumberLiteral>(value));
+            }
+        }
+    }
+    // nothing to simplify
+    if (lhs == operation -> get_lhs() && rhs == operation -> get_rhs()) {
+        return operation;
+    }
+    return arena.make<BinaryOperation>(binary_operator, lhs, rhs);
+}
+
+ast::Expression *ast::NumberLiteral::simplify(Simplifier &) {
+    return this;
+}
+
+ast::Expression *ast::VariableReference::simplify(Simplifier &) {
+    return this;
+}
+
+ast::Expression *ast::FunctionCall::simplify(Simplifier &simplifier) {
+    llvm::SmallVector<Expression *, 8> simplified_arguments;
+    bool simplified = false;
+    for (auto *argument : arguments) {
+        simplified_arguments.push_back(argument -> simplify(simplifier));
+        simplified |= simplified_arguments.back() != argument;
+    }
+    // nothing to simplify
+    if (!simplified) {
+        return this;
+    }
+    Arena &arena = simplifier.get_arena();
+    return arena.make<FunctionCall>(callee, arena.copy<Expression *>(simplified_arguments));
+}
+
+ast::Expression *ast::BinaryOperation::simplify(Simplifier &simplifier) {
+    Expression *lhs_simplified = lhs -> simplify(simplifier);
+    Expression *rhs_simplified = rhs -> simplify(simplifier);
+    return simplifier.simplify_operation(this, lhs_simplified, rhs_simplified);
+}
+
+ast::Expression *ast::UnaryOperation::simplify(Simplifier &simplifier) {
+    Expression *operand_simplified = operand -> simplify(simplifier);
+    // nothing to simplify
+    if (operand_simplified == operand) {
+        return this;
+    }
+    return simplifier.get_arena().make<UnaryOperation>(unary_operator, operand_simplified);
+}
+
+ast::Expression *ast::IfExpression::simplify(Simplifier &simplifier) {
+    Expression *condition_simplified = condition -> simplify(simplifier);
+    Expression *then_simplified = then_expression -> simplify(simplifier);
+    Expression *else_simplified = else_expression -> simplify(simplifier);
+    // constant condition - keep the branch taken, the other one never runs
+    if (auto *literal = llvm::dyn_cast<NumberLiteral>(condition_simplified)) {
+        // neither 0 nor NaN, as fcmp one
+        bool taken = literal -> get_value() != 0.0 && !std::isnan(literal -> get_value());
+        // the if, its condition, and the branch not taken
+        simplifier.remove_nodes(2 + count_nodes(taken ? else_simplified : then_simplified));
+        return taken ? then_simplified : else_simplified;
+    }
+    // nothing to simplify
+    if (condition_simplified == condition && then_simplified == then_expression && else_simplified == else_expression) {
+        return this;
+    }
+    return simplifier.get_arena().make<IfExpression>(condition_simplified, then_simplified, else_simplified);
+}
+
+ast::Expression *ast::ForExpression::simplify(Simplifier &simplifier) {
+    Expression *start_simplified = start -> simplify(simplifier);
+    Expression *end_simplified = end -> simplify(simplifier);
+    Expression *step_simplified = step ? step -> simplify(simplifier) : nullptr;
+    Expression *body_simplified = body -> simplify(simplifier);
+    // nothing to simplify
+    if (start_simplified == start && end_simplified == end && step_simplified == step && body_simplified == body) {
+        return this;
+    }
+    return simplifier.get_arena().make<ForExpression>(variable, start_simplified, end_simplified, step_simplified, body_simplified);
+}
+
+ast::Expression *ast::VarExpression::simplify(Simplifier &simplifier) {
+    llvm::SmallVector<VariableDefinition, 4> simplified_variables;
+    bool simplified = false;
+    for (auto &variable : variables) {
+        Expression *initializer = variable.initializer ? variable.initializer -> simplify(simplifier) : nullptr;
+        simplified_variables.push_back({ variable.name, initializer });
+        simplified |= initializer != variable.initializer;
+    }
+    Expression *body_simplified = body -> simplify(simplifier);
+    // nothing to simplify
+    if (!simplified && body_simplified == body) {
+        return this;
+    }
+    Arena &arena = simplifier.get_arena();
+    return arena.make<VarExpression>(arena.copy<VariableDefinition>(simplified_variables), body_simplified);
+}
+
+void ast::FunctionDefinition::simplify(Simplifier &simplifier) {
+    body = body -> simplify(simplifier);
+}
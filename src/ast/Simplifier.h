@@ -0,0 +1,46 @@
+#ifndef __SIMPLIFIER_H__
+#define __SIMPLIFIER_H__
+
+#include "AST.h"
+
+namespace ast {
+
+    // Floating point semantics the simplifier (and code generation) may relax.
+    // By default they are all strict IEEE 754.
+    struct FloatingPointOptions {
+        // +0 and -0 may be treated alike (e.g. x + 0 -> x)
+        bool no_signed_zeros = false;
+        // operands and results are never NaN
+        bool no_nans = false;
+        // operands and results are never infinite
+        bool no_infs = false;
+        // operations may be reassociated (e.g. (x + 1) + 2 -> x + 3)
+        bool reassociate = false;
+    };
+
+    // Simplifier rewrites an AST between parsing and code generation:
+    // it folds constant subtrees and removes algebraic identities that
+    // hold under the floating point options, counting the nodes removed.
+    // New nodes are allocated in the arena of the item being simplified.
+    class Simplifier {
+
+        Arena &arena;
+        const FloatingPointOptions &options;
+        unsigned removed_nodes = 0;
+
+        public:
+            Simplifier(Arena &arena, const FloatingPointOptions &options)
+                : arena(arena), options(options) {}
+            // simplify operation, whose operands are simplified already
+            Expression *simplify_operation(BinaryOperation *operation, Expression *lhs, Expression *rhs);
+            // count nodes removed by a rewrite (e.g. an if and its constant condition)
+            void remove_nodes(unsigned nodes) { removed_nodes += nodes; }
+            // nodes removed so far
+            unsigned get_removed_nodes() const { return removed_nodes; }
+            Arena &get_arena() { return arena; }
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,254 @@
+#include "Batch.h"
+#include <cstring>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/Host.h"
+#include "../optimizer/Optimizer.h"
+
+// This numbers kernels, so that their names are unique
+static unsigned kernels = 0;
+
+static llvm::Error string_error(const llvm::Twine &message) {
+    return llvm::make_error<llvm::StringError>(message, llvm::inconvertibleErrorCode());
+}
+
+// generate code for the definitions of the functions called in the current module
+// of session, then for those they call, and so on (externs stay declarations)
+static bool generate_callees(session::CompilerSession &session) {
+    while (1) {
+        llvm::SmallVector<ast::FunctionDefinition *, 8> callees;
+        for (auto &function : *session.module) {
+            if (!function.isDeclaration()) {
+                continue;
+            }
+            // vector code is named e.g. f.v4 after function f
+            llvm::StringRef name = function.getName().split('.').first;
+            if (auto definition = session.function_definitions.lookup(session.symbol_table.intern(name))) {
+                callees.push_back(definition.get());
+            }
+        }
+        if (callees.empty()) {
+            return true;
+        }
+        for (auto *callee : callees) {
+            if (!callee -> codegen(session)) {
+                return false;
+            }
+        }
+    }
+}
+
+// widest vector of doubles the host CPU computes on
+static unsigned get_host_vector_width() {
+    llvm::StringMap<bool> features;
+    llvm::sys::getHostCPUFeatures(features);
+    if (features.lookup("avx512f")) {
+        return 8;
+    }
+    if (features.lookup("avx")) {
+        return 4;
+    }
+    // SSE2 or equivalent
+    return 2;
+}
+
+// generate loop calling function on rows first..rows-1, width rows at once
+// (function then works on vectors of width doubles), return rows done
+static llvm::Value *generate_loop(session::CompilerSession &session, llvm::Function *function, unsigned width,
+    llvm::ArrayRef<llvm::Value *> columns, llvm::Value *results, llvm::Value *first, llvm::Value *rows) {
+    auto &context = *session.context;
+    auto &builder = *session.builder;
+    llvm::Type *row_type = builder.getInt64Ty();
+    llvm::Type *double_type = builder.getDoubleTy();
+    llvm::Type *value_type = function -> getReturnType();
+    llvm::Function *kernel = builder.GetInsertBlock() -> getParent();
+    llvm::BasicBlock *before = builder.GetInsertBlock();
+    llvm::BasicBlock *body = llvm::BasicBlock::Create(context, width == 1 ? "loop" : "vector_loop", kernel);
+    llvm::BasicBlock *after = llvm::BasicBlock::Create(context, width == 1 ? "loop_end" : "vector_loop_end", kernel);
+    // loop over a multiple of width rows
+    llvm::Value *last = width == 1 ? rows : builder.CreateAnd(rows, builder.getInt64(~(uint64_t) (width - 1)), "vector_rows");
+    builder.CreateCondBr(builder.CreateICmpEQ(first, last), after, body);
+    // results[row] = function(columns[0][row], ...)
+    builder.SetInsertPoint(body);
+    llvm::PHINode *row = builder.CreatePHI(row_type, 2, "row");
+    row -> addIncoming(first, before);
+    llvm::PointerType *value_pointer_type = llvm::PointerType::getUnqual(value_type);
+    llvm::SmallVector<llvm::Value *, 8> arguments;
+    for (llvm::Value *column : columns) {
+        llvm::Value *address = builder.CreateInBoundsGEP(double_type, column, row);
+        address = builder.CreateBitCast(address, value_pointer_type);
+        arguments.push_back(builder.CreateAlignedLoad(value_type, address, llvm::Align(alignof(double))));
+    }
+    llvm::Value *result = builder.CreateCall(function, arguments, "result");
+    llvm::Value *address = builder.CreateInBoundsGEP(double_type, results, row);
+    address = builder.CreateBitCast(address, value_pointer_type);
+    builder.CreateAlignedStore(result, address, llvm::Align(alignof(double)));
+    llvm::Value *next_row = builder.CreateNUWAdd(row, builder.getInt64(width), "next_row");
+    row -> addIncoming(next_row, body);
+    builder.CreateCondBr(builder.CreateICmpEQ(next_row, last), after, body);
+    builder.SetInsertPoint(after);
+    return last;
+}
+
+// generate kernel calling function on every row, vector_function (if any) on as many as possible
+static llvm::Function *generate_kernel(session::CompilerSession &session, llvm::Function *function,
+    llvm::Function *vector_function, unsigned vector_width, const std::string &name) {
+    auto &context = *session.context;
+    auto &builder = *session.builder;
+    llvm::Type *row_type = builder.getInt64Ty();
+    llvm::PointerType *column_type = llvm::PointerType::getUnqual(builder.getDoubleTy());
+    // void kernel(const double *const *columns, double *results, uint64_t rows)
+    llvm::FunctionType *kernel_type = llvm::FunctionType::get(builder.getVoidTy(),
+        { llvm::PointerType::getUnqual(column_type), column_type, row_type }, false);
+    llvm::Function *kernel = llvm::Function::Create(kernel_type, llvm::Function::ExternalLinkage, name, session.module.get());
+    llvm::Argument *columns = kernel -> getArg(0), *results = kernel -> getArg(1), *rows = kernel -> getArg(2);
+    columns -> setName("columns");
+    results -> setName("results");
+    rows -> setName("rows");
+    // results do not overlap columns: stores cannot change the values loaded
+    kernel -> addParamAttr(0, llvm::Attribute::ReadOnly);
+    kernel -> addParamAttr(0, llvm::Attribute::NoCapture);
+    kernel -> addParamAttr(1, llvm::Attribute::NoAlias);
+    kernel -> addParamAttr(1, llvm::Attribute::NoCapture);
+    // load column addresses once
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", kernel));
+    llvm::SmallVector<llvm::Value *, 8> column_addresses;
+    for (unsigned i = 0; i < function -> arg_size(); i++) {
+        llvm::Value *address = builder.CreateInBoundsGEP(column_type, columns, builder.getInt64(i));
+        column_addresses.push_back(builder.CreateLoad(column_type, address, "column"));
+    }
+    // vector rows first, then remaining rows one by one
+    llvm::Value *first = builder.getInt64(0);
+    if (vector_function) {
+        first = generate_loop(session, vector_function, vector_width, column_addresses, results, first, rows);
+    }
+    generate_loop(session, function, 1, column_addresses, results, first, rows);
+    builder.CreateRetVoid();
+    return kernel;
+}
+
+llvm::Expected<batch::Kernel> batch::compile(session::CompilerSession &session, jit::KaleidoscopeJIT &jit, llvm::StringRef function) {
+    auto definition = session.function_definitions.lookup(session.symbol_table.intern(function));
+    if (!definition) {
+        return string_error("no definition of function " + function);
+    }
+    auto target_machine = jit::KaleidoscopeJIT::create_target_machine();
+    if (!target_machine) {
+        return target_machine.takeError();
+    }
+    // generate function and its callees in a module of their own
+    session.initialize_module("batch");
+    session.module -> setDataLayout((*target_machine) -> createDataLayout());
+    session.module -> setTargetTriple((*target_machine) -> getTargetTriple().str());
+    llvm::Function *ir = definition -> codegen(session);
+    bool generated = ir && generate_callees(session);
+    // generate them again over vectors
+    llvm::Function *vector_ir = nullptr;
+    unsigned vector_width = session.options.vector_width ? session.options.vector_width : get_host_vector_width();
+    if (generated && vector_width > 1) {
+        session.module_functions.clear();
+        session.vector_width = vector_width;
+        vector_ir = definition -> codegen(session);
+        generated = vector_ir && generate_callees(session);
+        session.vector_width = 1;
+    }
+    if (!generated) {
+        session.initialize_module();
+        session.module -> setDataLayout(jit.get_data_layout());
+        return string_error("cannot generate code for function " + function);
+    }
+    // keep functions private to the kernel, they are defined in the JIT under the same names
+    for (auto &module_function : *session.module) {
+        if (!module_function.isDeclaration()) {
+            module_function.setLinkage(llvm::Function::InternalLinkage);
+        }
+    }
+    std::string name = "__batch." + function.str() + "." + std::to_string(++kernels);
+    unsigned arity = ir -> arg_size();
+    llvm::Function *kernel = generate_kernel(session, ir, vector_ir, vector_width, name);
+    llvm::verifyFunction(*kernel);
+    // inline functions into the loops (then vectorize the scalar one)
+    session.statistics.inlined_calls +=
+        optimizer::Optimizer::optimize_module(*session.module, target_machine -> get(), session.optimizer.get_level());
+    // hand module over to the JIT and start a new one
+    auto module = llvm::orc::ThreadSafeModule(std::move(session.module), std::move(session.context));
+    session.initialize_module();
+    session.module -> setDataLayout(jit.get_data_layout());
+    auto tracker = jit.create_resource_tracker();
+    if (auto error = jit.add_module(std::move(module), tracker)) {
+        return error;
+    }
+    auto symbol = jit.lookup(name);
+    if (!symbol) {
+        return llvm::joinErrors(symbol.takeError(), tracker -> remove());
+    }
+    return Kernel((Kernel::Loop) (intptr_t) symbol -> getAddress(), arity, tracker);
+}
+
+llvm::Expected<batch::Columns> batch::Columns::read_csv(const std::string &path, unsigned count) {
+    auto buffer = llvm::MemoryBuffer::getFileOrSTDIN(path);
+    if (!buffer) {
+        return llvm::createStringError(buffer.getError(), "cannot read '%s'", path.c_str());
+    }
+    Columns columns;
+    columns.storage.resize(count);
+    llvm::StringRef text = (*buffer) -> getBuffer();
+    llvm::SmallVector<llvm::StringRef, 8> fields;
+    for (unsigned line_number = 1; !text.empty(); line_number++) {
+        llvm::StringRef line;
+        std::tie(line, text) = text.split('\n');
+        line = line.trim();
+        if (line.empty()) {
+            continue;
+        }
+        fields.clear();
+        line.split(fields, ',');
+        // skip first line if it is a header
+        double value;
+        if (line_number == 1 && fields[0].trim().getAsDouble(value)) {
+            continue;
+        }
+        if (fields.size() != count) {
+            return string_error(path + ":" + llvm::Twine(line_number) + ": expected " + llvm::Twine(count) + " values");
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (fields[i].trim().getAsDouble(value)) {
+                return string_error(path + ":" + llvm::Twine(line_number) + ": invalid number '" + fields[i].trim() + "'");
+            }
+            columns.storage[i].push_back(value);
+        }
+    }
+    columns.rows = count ? columns.storage[0].size() : 0;
+    for (auto &column : columns.storage) {
+        columns.columns.push_back(column.data());
+    }
+    return columns;
+}
+
+llvm::Expected<batch::Columns> batch::Columns::read_binary(const std::string &path, unsigned count) {
+    auto buffer = llvm::MemoryBuffer::getFileOrSTDIN(path, false, false);
+    if (!buffer) {
+        return llvm::createStringError(buffer.getError(), "cannot read '%s'", path.c_str());
+    }
+    size_t size = (*buffer) -> getBufferSize();
+    if (!count || size % (count * sizeof(double))) {
+        return string_error(path + ": size is not a multiple of " + llvm::Twine(count) + " columns of doubles");
+    }
+    Columns columns;
+    columns.rows = size / (count * sizeof(double));
+    columns.buffer = std::move(*buffer);
+    const char *start = columns.buffer -> getBufferStart();
+    // point into the file, unless it is not aligned for doubles
+    if ((uintptr_t) start % alignof(double)) {
+        columns.storage.resize(count, std::vector<double>(columns.rows));
+        for (unsigned i = 0; i < count; i++) {
+            memcpy(columns.storage[i].data(), start + i * columns.rows * sizeof(double), columns.rows * sizeof(double));
+            columns.columns.push_back(columns.storage[i].data());
+        }
+        return columns;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        columns.columns.push_back((const double *) start + i * columns.rows);
+    }
+    return columns;
+}
@@ -0,0 +1,78 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "../jit/JIT.h"
+#include "../session/Session.h"
+
+namespace batch {
+
+    // Kernel applies a function to every row of columns of doubles:
+    // results[row] = function(columns[0][row], ..., columns[arity - 1][row]).
+    // The loop is compiled together with the function (and the functions it
+    // calls), so that LLVM can inline the function into it and vectorize it.
+    // Unless disabled, the function is also generated over vectors of doubles
+    // (see session::Options::vector_width), for the loop to run on as many
+    // rows at once; remaining rows are run on one by one.
+    class Kernel {
+
+        public:
+            // This is the compiled loop
+            typedef void (*Loop)(const double *const *columns, double *results, uint64_t rows);
+
+        private:
+            Loop loop;
+            unsigned arity;
+            llvm::orc::ResourceTrackerSP tracker;
+
+        public:
+            Kernel(Loop loop, unsigned arity, llvm::orc::ResourceTrackerSP tracker)
+                : loop(loop), arity(arity), tracker(std::move(tracker)) {}
+            unsigned get_arity() const { return arity; }
+            // run kernel over rows of columns (arity of them), results must not overlap them
+            void run(llvm::ArrayRef<const double *> columns, double *results, size_t rows) const {
+                loop(columns.data(), results, rows);
+            }
+            // remove the code of the kernel from the JIT
+            llvm::Error remove() { return tracker -> remove(); }
+
+    };
+
+    // Compile kernel of function, from the most recent definitions of session.
+    // The kernel is optimized with LLVM's standard pipeline of the session level.
+    llvm::Expected<Kernel> compile(session::CompilerSession &session, jit::KaleidoscopeJIT &jit, llvm::StringRef function);
+
+    // Columns holds columns of doubles of the same length, read from a file
+    class Columns {
+
+        // This is the file read, binary columns point into it
+        std::unique_ptr<llvm::MemoryBuffer> buffer;
+
+        // These are the columns parsed from text
+        std::vector<std::vector<double>> storage;
+
+        std::vector<const double *> columns;
+        size_t rows = 0;
+
+        public:
+            // Read count columns from CSV file (standard input if "-"): one row per line,
+            // values separated by commas. A first line that is not numeric is a header.
+            static llvm::Expected<Columns> read_csv(const std::string &path, unsigned count);
+            // Read count columns from binary file: column after column of native doubles
+            static llvm::Expected<Columns> read_binary(const std::string &path, unsigned count);
+            llvm::ArrayRef<const double *> get_columns() const { return columns; }
+            size_t get_rows() const { return rows; }
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,435 @@
+#include "Bundle.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+#include "../session/Session.h"
+
+// This starts every bundle
+static const char MAGIC[4] = { 'K', 'B', 'C', '\0' };
+
+// These are the kinds of a missing expression (e.g. the step of a for), and of
+// a number literal of a small integer value (stored as an integer, in fewer
+// bytes than a double), after the kinds of ast::Expression
+static const uint8_t NONE = 0xff;
+static const uint8_t INTEGER_LITERAL = 0xfe;
+
+static llvm::Error string_error(const llvm::Twine &message) {
+    return llvm::make_error<llvm::StringError>(message, llvm::inconvertibleErrorCode());
+}
+
+void bundle::Writer::write_integer(uint64_t value) {
+    uint8_t bytes[16];
+    unsigned length = llvm::encodeULEB128(value, bytes);
+    items.append(bytes, bytes + length);
+}
+
+// write value as 8 bytes, little endian
+void bundle::Writer::write_double(double value) {
+    char bytes[8];
+    llvm::support::endian::write64le(bytes, llvm::DoubleToBits(value));
+    items.append(bytes, bytes + sizeof(bytes));
+}
+
+// write index of symbol, adding it to the symbols of the bundle if new
+void bundle::Writer::write_symbol(symbols::Symbol symbol) {
+    // indices are stored plus one, 0 is for symbols not in the bundle yet
+    unsigned index = symbol_indices.lookup(symbol);
+    if (!index) {
+        symbols.push_back(symbol);
+        index = symbols.size();
+        symbol_indices.set(symbol, index);
+    }
+    write_integer(index - 1);
+}
+
+void bundle::Writer::write_item_header(ItemKind kind, lexer::Location location) {
+    items.push_back((char) kind);
+    write_integer(file);
+    write_integer(location.line);
+    write_integer(location.column);
+    item_count++;
+}
+
+void bundle::Writer::write_declaration(const ast::FunctionDeclaration &declaration) {
+    write_symbol(declaration.get_name());
+    write_integer(declaration.get_arguments().size());
+    for (symbols::Symbol argument : declaration.get_arguments()) {
+        write_symbol(argument);
+    }
+    items.push_back(declaration.is_operator());
+    write_integer(declaration.get_precedence());
+}
+
+void bundle::Writer::write_expression(const ast::Expression *expression) {
+    // nested as the reader counts it, missing expressions included
+    depth++;
+    deepest = std::max(deepest, depth);
+    auto leave = llvm::make_scope_exit([this] { depth--; });
+    if (!expression) {
+        items.push_back(NONE);
+        return;
+    }
+    if (auto *literal = llvm::dyn_cast<ast::NumberLiteral>(expression)) {
+        // integers up to 2^53 are exact doubles (-0 is not an integer)
+        double value = literal -> get_value();
+        if (value >= 0 && value < 9007199254740992.0 && value == (uint64_t) value && !std::signbit(value)) {
+            items.push_back(INTEGER_LITERAL);
+            write_integer((uint64_t) value);
+            return;
+        }
+    }
+    items.push_back(expression -> get_kind());
+    switch (expression -> get_kind()) {
+        case ast::Expression::NUMBER_LITERAL:
+            write_double(llvm::cast<ast::NumberLiteral>(expression) -> get_value());
+            break;
+        case ast::Expression::VARIABLE_REFERENCE:
+            write_symbol(llvm::cast<ast::VariableReference>(expression) -> get_variable());
+            break;
+        case ast::Expression::FUNCTION_CALL: {
+            auto *call = llvm::cast<ast::FunctionCall>(expression);
+            write_symbol(call -> get_callee());
+            write_integer(call -> get_arguments().size());
+            for (auto *argument : call -> get_arguments()) {
+                write_expression(argument);
+            }
+            break;
+        }
+        case ast::Expression::BINARY_OPERATION: {
+            auto *operation = llvm::cast<ast::BinaryOperation>(expression);
+            items.push_back(operation -> get_operator());
+            write_expression(operation -> get_lhs());
+            write_expression(operation -> get_rhs());
+            break;
+        }
+        case ast::Expression::UNARY_OPERATION: {
+            auto *operation = llvm::cast<ast::UnaryOperation>(expression);
+            items.push_back(operation -> get_operator());
+            write_expression(operation -> get_operand());
+            break;
+        }
+        case ast::Expression::IF_EXPRESSION: {
+            auto *if_expression = llvm::cast<ast::IfExpression>(expression);
+            write_expression(if_expression -> get_condition());
+            write_expression(if_expression -> get_then());
+            write_expression(if_expression -> get_else());
+            break;
+        }
+        case ast::Expression::FOR_EXPRESSION: {
+            auto *for_expression = llvm::cast<ast::ForExpression>(expression);
+            write_symbol(for_expression -> get_variable());
+            write_expression(for_expression -> get_start());
+            write_expression(for_expression -> get_end());
+            write_expression(for_expression -> get_step());
+            write_expression(for_expression -> get_body());
+            break;
+        }
+        case ast::Expression::VAR_EXPRESSION: {
+            auto *var = llvm::cast<ast::VarExpression>(expression);
+            write_integer(var -> get_variables().size());
+            for (auto &variable : var -> get_variables()) {
+                write_symbol(variable.name);
+                write_expression(variable.initializer);
+            }
+            write_expression(var -> get_body());
+            break;
+        }
+    }
+}
+
+void bundle::Writer::set_file(llvm::StringRef name) {
+    auto inserted = file_indices.try_emplace(name, files.size());
+    if (inserted.second) {
+        files.push_back(name.str());
+    }
+    file = inserted.first -> getValue();
+}
+
+void bundle::Writer::add_extern(const ast::FunctionDeclaration &declaration, lexer::Location location) {
+    write_item_header(ItemKind::EXTERN, location);
+    write_declaration(declaration);
+}
+
+void bundle::Writer::add_definition(const ast::FunctionDefinition &definition, const llvm::MD5::MD5Result &hash,
+    lexer::Location location) {
+    write_item_header(ItemKind::DEFINITION, location);
+    items.append(hash.Bytes.begin(), hash.Bytes.end());
+    write_declaration(*definition.get_declaration());
+    write_expression(definition.get_body());
+}
+
+void bundle::Writer::add_top_level_expression(const ast::FunctionDefinition &definition, lexer::Location location) {
+    write_item_header(ItemKind::TOP_LEVEL_EXPRESSION, location);
+    write_declaration(*definition.get_declaration());
+    write_expression(definition.get_body());
+}
+
+llvm::Error bundle::Writer::write(const std::string &path) const {
+    if (deepest > MAX_DEPTH) {
+        return string_error(path + ": expressions nest deeper than " + llvm::Twine(MAX_DEPTH) + " levels");
+    }
+    std::error_code error;
+    llvm::raw_fd_ostream stream(path, error, llvm::sys::fs::OF_None);
+    if (error) {
+        return llvm::createStringError(error, "cannot open '%s'", path.c_str());
+    }
+    char version[4];
+    llvm::support::endian::write32le(version, VERSION);
+    stream.write(MAGIC, sizeof(MAGIC));
+    stream.write(version, sizeof(version));
+    llvm::encodeULEB128(files.size(), stream);
+    for (auto &name : files) {
+        llvm::encodeULEB128(name.size(), stream);
+        stream << name;
+    }
+    llvm::encodeULEB128(symbols.size(), stream);
+    for (symbols::Symbol symbol : symbols) {
+        llvm::StringRef name = symbol_table.get_name(symbol);
+        llvm::encodeULEB128(name.size(), stream);
+        stream << name;
+    }
+    llvm::encodeULEB128(item_count, stream);
+    stream.write(items.data(), items.size());
+    stream.close();
+    if (stream.has_error()) {
+        return llvm::createStringError(stream.error(), "cannot write '%s'", path.c_str());
+    }
+    return llvm::Error::success();
+}
+
+// read integer, 0 (and malformed) if past the end of the bundle
+uint64_t bundle::Reader::read_integer() {
+    unsigned length;
+    const char *error = nullptr;
+    uint64_t value = llvm::decodeULEB128(cursor, &length, end, &error);
+    if (error) {
+        malformed = true;
+        return 0;
+    }
+    cursor += length;
+    return value;
+}
+
+double bundle::Reader::read_double() {
+    if (end - cursor < 8) {
+        malformed = true;
+        return 0;
+    }
+    double value = llvm::BitsToDouble(llvm::support::endian::read64le(cursor));
+    cursor += 8;
+    return value;
+}
+
+// read length, then name of that length (pointing into the bundle)
+llvm::StringRef bundle::Reader::read_name() {
+    uint64_t length = read_integer();
+    if (length > (uint64_t) (end - cursor)) {
+        malformed = true;
+        return "";
+    }
+    llvm::StringRef name((const char *) cursor, length);
+    cursor += length;
+    return name;
+}
+
+symbols::Symbol bundle::Reader::read_symbol() {
+    uint64_t index = read_integer();
+    if (index >= symbols.size()) {
+        malformed = true;
+        return 0;
+    }
+    return symbols[index];
+}
+
+ast::FunctionDeclaration *bundle::Reader::read_declaration(ast::Arena &arena) {
+    symbols::Symbol name = read_symbol();
+    llvm::SmallVector<symbols::Symbol, 8> arguments;
+    for (uint64_t count = read_integer(); count && !malformed; count--) {
+        arguments.push_back(read_symbol());
+    }
+    bool operator_function = cursor != end && *cursor++;
+    uint64_t precedence = read_integer();
+    // an operator is declared as the parser would: unary or binary, then a
+    // character it accepts, with as many operands, and a valid precedence
+    if (!malformed && operator_function) {
+        llvm::StringRef operator_name = symbol_table -> get_name(name);
+        bool unary = operator_name.consume_front("unary");
+        bool binary = !unary && operator_name.consume_front("binary");
+        malformed = (!unary && !binary) || operator_name.size() != 1
+            || !session::is_operator_character((unsigned char) operator_name[0])
+            || arguments.size() != (binary ? 2 : 1)
+            || (binary && session::BUILTIN_BINARY_OPERATOR_PRECEDENCES[(unsigned char) operator_name[0]] >= 0)
+            || (binary ? precedence < (uint64_t) session::MIN_PRECEDENCE || precedence > (uint64_t) session::MAX_PRECEDENCE
+                       : precedence != 0);
+    }
+    if (malformed) {
+        return nullptr;
+    }
+    return arena.make<ast::FunctionDeclaration>(name, arena.copy<symbols::Symbol>(arguments), operator_function, (int) precedence);
+}
+
+// read expression, null if missing (or malformed)
+ast::Expression *bundle::Reader::read_expression(ast::Arena &arena) {
+    if (cursor == end || depth == MAX_DEPTH) {
+        malformed = true;
+        return nullptr;
+    }
+    depth++;
+    auto leave = llvm::make_scope_exit([this] { depth--; });
+    uint8_t kind = *cursor++;
+    switch (kind) {
+        case NONE:
+            return nullptr;
+        case INTEGER_LITERAL:
+            return arena.make<ast::NumberLiteral>((double) read_integer());
+        case ast::Expression::NUMBER_LITERAL:
+            return arena.make<ast::NumberLiteral>(read_double());
+        case ast::Expression::VARIABLE_REFERENCE:
+            return arena.make<ast::VariableReference>(read_symbol());
+        case ast::Expression::FUNCTION_CALL: {
+            symbols::Symbol callee = read_symbol();
+            llvm::SmallVector<ast::Expression *, 8> arguments;
+            for (uint64_t count = read_integer(); count && !malformed; count--) {
+                arguments.push_back(read_expression(arena));
+                malformed |= !arguments.back();
+            }
+            return malformed ? nullptr : arena.make<ast::FunctionCall>(callee, arena.copy<ast::Expression *>(arguments));
+        }
+        case ast::Expression::BINARY_OPERATION:
+        case ast::Expression::UNARY_OPERATION: {
+            char operator_character = cursor != end ? *cursor++ : 0;
+            ast::Expression *lhs = read_expression(arena);
+            ast::Expression *rhs = kind == ast::Expression::BINARY_OPERATION && lhs ? read_expression(arena) : nullptr;
+            if (!lhs || (kind == ast::Expression::BINARY_OPERATION && !rhs)) {
+                malformed = true;
+                return nullptr;
+            }
+            if (kind == ast::Expression::UNARY_OPERATION) {
+                return arena.make<ast::UnaryOperation>(operator_character, lhs);
+            }
+            return arena.make<ast::BinaryOperation>(operator_character, lhs, rhs);
+        }
+        case ast::Expression::IF_EXPRESSION: {
+            ast::Expression *condition = read_expression(arena);
+            ast::Expression *then_expression = condition ? read_expression(arena) : nullptr;
+            ast::Expression *else_expression = then_expression ? read_expression(arena) : nullptr;
+            if (!else_expression) {
+                malformed = true;
+                return nullptr;
+            }
+            return arena.make<ast::IfExpression>(condition, then_expression, else_expression);
+        }
+        case ast::Expression::FOR_EXPRESSION: {
+            symbols::Symbol variable = read_symbol();
+            ast::Expression *start = read_expression(arena);
+            ast::Expression *end_expression = start ? read_expression(arena) : nullptr;
+            // the step may be missing
+            ast::Expression *step = end_expression ? read_expression(arena) : nullptr;
+            ast::Expression *body = end_expression && !malformed ? read_expression(arena) : nullptr;
+            if (!body) {
+                malformed = true;
+                return nullptr;
+            }
+            return arena.make<ast::ForExpression>(variable, start, end_expression, step, body);
+        }
+        case ast::Expression::VAR_EXPRESSION: {
+            llvm::SmallVector<ast::VariableDefinition, 4> variables;
+            for (uint64_t count = read_integer(); count && !malformed; count--) {
+                symbols::Symbol name = read_symbol();
+                // the initializer may be missing
+                variables.push_back({ name, read_expression(arena) });
+            }
+            ast::Expression *body = malformed ? nullptr : read_expression(arena);
+            if (!body) {
+                malformed = true;
+                return nullptr;
+            }
+            return arena.make<ast::VarExpression>(arena.copy<ast::VariableDefinition>(variables), body);
+        }
+        default:
+            malformed = true;
+            return nullptr;
+    }
+}
+
+llvm::Expected<bundle::Reader> bundle::Reader::open(const std::string &path, symbols::SymbolTable &symbol_table) {
+    // no need for a terminating null, so that the file can be mapped
+    auto buffer = llvm::MemoryBuffer::getFile(path, false, false);
+    if (!buffer) {
+        return llvm::createStringError(buffer.getError(), "cannot read '%s'", path.c_str());
+    }
+    Reader reader;
+    reader.symbol_table = &symbol_table;
+    reader.buffer = std::move(*buffer);
+    reader.cursor = (const uint8_t *) reader.buffer -> getBufferStart();
+    reader.end = (const uint8_t *) reader.buffer -> getBufferEnd();
+    // check header
+    if (reader.end - reader.cursor < 8 || memcmp(reader.cursor, MAGIC, sizeof(MAGIC))) {
+        return string_error(path + ": not a bundle");
+    }
+    uint32_t version = llvm::support::endian::read32le(reader.cursor + 4);
+    if (version != VERSION) {
+        return string_error(path + ": bundle version " + llvm::Twine(version) + ", expected " + llvm::Twine(VERSION));
+    }
+    reader.cursor += 8;
+    // read files and symbols, intern symbols once for all items
+    for (uint64_t count = reader.read_integer(); count && !reader.malformed; count--) {
+        reader.files.push_back(reader.read_name());
+    }
+    for (uint64_t count = reader.read_integer(); count && !reader.malformed; count--) {
+        reader.symbols.push_back(symbol_table.intern(reader.read_name()));
+    }
+    reader.remaining_items = reader.read_integer();
+    if (reader.malformed) {
+        return string_error(path + ": malformed bundle");
+    }
+    return reader;
+}
+
+llvm::Expected<bool> bundle::Reader::read_item(Item &item) {
+    if (!remaining_items) {
+        return false;
+    }
+    remaining_items--;
+    item = Item();
+    uint8_t kind = cursor != end ? *cursor++ : NONE;
+    uint64_t file = read_integer();
+    item.location.line = read_integer();
+    item.location.column = read_integer();
+    if (kind > (uint8_t) ItemKind::TOP_LEVEL_EXPRESSION || file >= files.size()) {
+        malformed = true;
+    }
+    if (kind == (uint8_t) ItemKind::DEFINITION) {
+        if (end - cursor < (ptrdiff_t) sizeof(item.hash.Bytes)) {
+            malformed = true;
+        } else {
+            memcpy(item.hash.Bytes.data(), cursor, sizeof(item.hash.Bytes));
+            cursor += sizeof(item.hash.Bytes);
+        }
+    }
+    if (malformed) {
+        return string_error(buffer -> getBufferIdentifier() + ": malformed bundle");
+    }
+    item.kind = (ItemKind) kind;
+    item.file = files[file];
+    // build the nodes of the item in an arena of its own, as the parser does
+    auto arena = std::make_shared<ast::Arena>();
+    auto *declaration = read_declaration(*arena);
+    if (declaration && item.kind == ItemKind::EXTERN) {
+        item.declaration = ast::Unit<ast::FunctionDeclaration>(arena, declaration);
+        return true;
+    }
+    auto *body = declaration ? read_expression(*arena) : nullptr;
+    if (!body) {
+        return string_error(buffer -> getBufferIdentifier() + ": malformed bundle");
+    }
+    item.definition = ast::Unit<ast::FunctionDefinition>(arena, arena -> make<ast::FunctionDefinition>(declaration, body));
+    return true;
+}
@@ -0,0 +1,151 @@
+#ifndef __BUNDLE_H__
+#define __BUNDLE_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "../ast/AST.h"
+#include "../lexer/Lexer.h"
+#include "../symbols/Symbols.h"
+
+// A bundle holds the top level items of scripts as parsed, so that they
+// can be run again without lexing nor parsing them. It is laid out as:
+//
+//   header   "KBC" 0, version (4 bytes, little endian)
+//   files    count, then the length and bytes of every name
+//   symbols  count, then the length and bytes of every name
+//   items    count, then every item in the order of the input
+//
+// Integers are ULEB128, numbers 8 bytes little endian, and names are referred
+// to by their index in their table. An item is its kind, file, line and column,
+// the hash of its tokens and the precedences of their operators (for
+// definitions, the object cache is keyed by it),
+// its declaration (name, arguments, operator flag and precedence), then its
+// body (for definitions and top level expressions) in prefix order: the kind
+// of every expression (NONE for a missing one, INTEGER_LITERAL for a number
+// literal of an integer value), its fields, then its children.
+namespace bundle {
+
+    // This is the version of the format, to bump on every change of it
+    constexpr uint32_t VERSION = 1;
+
+    // This is the deepest nesting of expressions in a bundle, past which it is
+    // malformed (nor written): far deeper than scripts nest, and within the stack
+    constexpr unsigned MAX_DEPTH = 10000;
+
+    // Kind of a top level item
+    enum class ItemKind : uint8_t {
+        EXTERN = 0,
+        DEFINITION = 1,
+        TOP_LEVEL_EXPRESSION = 2,
+    };
+
+    // A top level item read from a bundle
+    struct Item {
+        ItemKind kind;
+        // definition (or top level expression), or extern declaration
+        ast::Unit<ast::FunctionDefinition> definition;
+        ast::Unit<ast::FunctionDeclaration> declaration;
+        // hash of the tokens of a definition, and of the precedences of their operators
+        llvm::MD5::MD5Result hash;
+        // file the item was parsed from, and its position in it
+        llvm::StringRef file;
+        lexer::Location location;
+    };
+
+    // Writer appends items to a bundle in memory, then writes it to a file
+    class Writer {
+
+        // This names the symbols of the items
+        const symbols::SymbolTable &symbol_table;
+
+        // These are the files and the symbols of the items so far, with their indices
+        llvm::StringMap<unsigned> file_indices;
+        std::vector<std::string> files;
+        symbols::SymbolMap<unsigned> symbol_indices;
+        std::vector<symbols::Symbol> symbols;
+
+        // This is the file the items added next are from
+        unsigned file = 0;
+
+        // These are the items encoded so far
+        llvm::SmallVector<char, 0> items;
+        unsigned item_count = 0;
+
+        // This is the nesting of the expression being written, and the deepest one
+        unsigned depth = 0;
+        unsigned deepest = 0;
+
+        void write_integer(uint64_t value);
+        void write_double(double value);
+        void write_symbol(symbols::Symbol symbol);
+        void write_item_header(ItemKind kind, lexer::Location location);
+        void write_declaration(const ast::FunctionDeclaration &declaration);
+        void write_expression(const ast::Expression *expression);
+
+        public:
+            Writer(const symbols::SymbolTable &symbol_table)
+                : symbol_table(symbol_table) {}
+            // Set the file the items added next were parsed from
+            void set_file(llvm::StringRef name);
+            // Append item at location of the current file
+            void add_extern(const ast::FunctionDeclaration &declaration, lexer::Location location);
+            void add_definition(const ast::FunctionDefinition &definition, const llvm::MD5::MD5Result &hash,
+                                lexer::Location location);
+            void add_top_level_expression(const ast::FunctionDefinition &definition, lexer::Location location);
+            unsigned get_item_count() const { return item_count; }
+            // Write bundle to file at path
+            llvm::Error write(const std::string &path) const;
+
+    };
+
+    // Reader reads the items of a bundle one by one, building their nodes in
+    // arenas as the parser does, in a fraction of the time. The file is
+    // memory-mapped (if large enough), and only read once.
+    class Reader {
+
+        // This is the bundle file, and the position of the reader in it
+        std::unique_ptr<llvm::MemoryBuffer> buffer;
+        const uint8_t *cursor = nullptr;
+        const uint8_t *end = nullptr;
+
+        // These are the files of the bundle (pointing into it), the symbols
+        // of the session its symbols are interned as, and their table
+        std::vector<llvm::StringRef> files;
+        std::vector<symbols::Symbol> symbols;
+        const symbols::SymbolTable *symbol_table = nullptr;
+
+        // This is the nesting of the expression being read
+        unsigned depth = 0;
+
+        // This counts the items left to read
+        uint64_t remaining_items = 0;
+
+        // This is set once the bundle turns out to be malformed
+        bool malformed = false;
+
+        uint64_t read_integer();
+        double read_double();
+        llvm::StringRef read_name();
+        symbols::Symbol read_symbol();
+        ast::FunctionDeclaration *read_declaration(ast::Arena &arena);
+        ast::Expression *read_expression(ast::Arena &arena);
+
+        public:
+            // Open bundle at path, interning its symbols into symbol_table
+            static llvm::Expected<Reader> open(const std::string &path, symbols::SymbolTable &symbol_table);
+            // Read the next item into item, return false after the last one
+            llvm::Expected<bool> read_item(Item &item);
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,245 @@
+#include "Driver.h"
+#include "../parser/Parser.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+// This is what a job hands back for a file: its module, as bitcode,
+// since modules cannot move between the contexts of different sessions
+struct CompiledFile {
+    bool succeeded = false;
+    llvm::SmallVector<char, 0> bitcode;
+    session::Statistics statistics;
+};
+
+// parse and generate code for every top level item of file
+static void compile_file(const std::string &file, const session::Options &options, CompiledFile &result) {
+    session::CompilerSession session(options);
+    llvm::TimeTraceScope trace("compile file", file);
+    if (!session.lexer.open_file(file)) {
+        return;
+    }
+    session.initialize_module(file);
+    session.module -> setTargetTriple(llvm::sys::getDefaultTargetTriple());
+    bool top_level_expressions = false;
+    session.lexer.get_next_token();
+    while (session.lexer.current_token != lexer::Token::END_OF_FILE && !session.too_many_errors()) {
+        session.item_location = session.lexer.location;
+        switch (session.lexer.current_token) {
+            case ';':
+                session.lexer.get_next_token();
+                break;
+            case lexer::Token::DEFINITION: {
+                ast::Unit<ast::FunctionDefinition> ast;
+                {
+                    profiler::Scope scope(session.profiler.get(), profiler::PARSE);
+                    ast = parser::parse_function_definition(session);
+                }
+                if (ast) {
+                    {
+                        profiler::Scope scope(session.profiler.get(), profiler::SIMPLIFY);
+                        session.simplify(ast);
+                    }
+                    profiler::Scope scope(session.profiler.get(), profiler::CODEGEN);
+                    ast -> codegen(session);
+                } else {
+                    // skip the rest of the item for error recovery
+                    session.lexer.synchronize();
+                }
+                break;
+            }
+            case lexer::Token::EXTERN:
+                if (auto ast = parser::parse_extern_function(session)) {
+                    if (ast -> codegen(session)) {
+                        session.declare_function(*ast);
+                    }
+                } else {
+                    // skip the rest of the item for error recovery
+                    session.lexer.synchronize();
+                }
+                break;
+            default:
+                // there is nothing to run them when compiling, parse and drop them
+                if (!parser::parse_top_level_expression(session)) {
+                    session.lexer.synchronize();
+                }
+                top_level_expressions = true;
+                break;
+        }
+    }
+    session.statistics.tokens = session.lexer.tokens_read;
+    result.statistics = session.statistics;
+    if (top_level_expressions) {
+        fprintf(stderr, "%s: warning: top level expressions are ignored when compiling\n", file.c_str());
+    }
+    if (session.errors) {
+        fprintf(stderr, "%s: %u error(s)\n", file.c_str(), session.errors.load());
+        return;
+    }
+    llvm::raw_svector_ostream stream(result.bitcode);
+    llvm::WriteBitcodeToFile(*session.module, stream);
+    result.succeeded = true;
+}
+
+// create target machine for the default triple and the cpu of output
+static std::unique_ptr<llvm::TargetMachine> create_target_machine(const driver::Output &output, unsigned optimization_level) {
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    std::string error;
+    const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (!target) {
+        fprintf(stderr, "error: %s\n", error.c_str());
+        return nullptr;
+    }
+    // host CPU, with every feature it has
+    std::string cpu = output.cpu;
+    llvm::SubtargetFeatures features;
+    if (cpu == "native") {
+        cpu = llvm::sys::getHostCPUName().str();
+        llvm::StringMap<bool> host_features;
+        llvm::sys::getHostCPUFeatures(host_features);
+        for (auto &feature : host_features) {
+            features.AddFeature(feature.first(), feature.second);
+        }
+    }
+    const llvm::CodeGenOpt::Level levels[] = {
+        llvm::CodeGenOpt::None, llvm::CodeGenOpt::Less, llvm::CodeGenOpt::Default, llvm::CodeGenOpt::Aggressive,
+    };
+    // position independent code, to be linked into any executable or library
+    return std::unique_ptr<llvm::TargetMachine>(target -> createTargetMachine(triple, cpu, features.getString(),
+        llvm::TargetOptions(), llvm::Reloc::PIC_, llvm::None, levels[optimization_level]));
+}
+
+// write module, compiled for target_machine, to output in the format it asks for
+static bool write_output(llvm::Module &module, const driver::Output &output, llvm::TargetMachine *target_machine) {
+    // record the CPU in functions, for code generated later from bitcode
+    if (!output.cpu.empty()) {
+        for (auto &function : module) {
+            if (!function.isDeclaration()) {
+                function.addFnAttr("target-cpu", target_machine -> getTargetCPU());
+                function.addFnAttr("target-features", target_machine -> getTargetFeatureString());
+            }
+        }
+    }
+    std::error_code error;
+    llvm::raw_fd_ostream stream(output.path, error,
+        output.emit == driver::Emit::ASSEMBLY || output.emit == driver::Emit::IR ? llvm::sys::fs::OF_Text : llvm::sys::fs::OF_None);
+    if (error) {
+        fprintf(stderr, "error: cannot open '%s': %s\n", output.path.c_str(), error.message().c_str());
+        return false;
+    }
+    switch (output.emit) {
+        case driver::Emit::BITCODE:
+            llvm::WriteBitcodeToFile(module, stream);
+            return true;
+        case driver::Emit::IR:
+            module.print(stream, nullptr);
+            return true;
+        case driver::Emit::OBJECT:
+        case driver::Emit::ASSEMBLY: {
+            llvm::legacy::PassManager pass_manager;
+            auto file_type = output.emit == driver::Emit::OBJECT ? llvm::CGFT_ObjectFile : llvm::CGFT_AssemblyFile;
+            if (target_machine -> addPassesToEmitFile(pass_manager, stream, nullptr, file_type)) {
+                fprintf(stderr, "error: target cannot emit a file of this type\n");
+                return false;
+            }
+            pass_manager.run(module);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool driver::compile_files(const std::vector<std::string> &files, unsigned jobs,
+                           const session::Options &options, const Output &output,
+                           session::Statistics &statistics) {
+    // compile files in parallel
+    std::vector<CompiledFile> results(files.size());
+    llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+    for (size_t i = 0; i < files.size(); i++) {
+        pool.async([&, i] {
+            // trace jobs on the threads of the pool too, handing their events
+            // over to the main thread (that writes the trace) once done
+            if (options.time_trace) {
+                llvm::timeTraceProfilerInitialize(0, "kaleidoscope");
+            }
+            compile_file(files[i], options, results[i]);
+            if (options.time_trace) {
+                llvm::timeTraceProfilerFinishThread();
+            }
+        });
+    }
+    pool.wait();
+    for (auto &result : results) {
+        statistics += result.statistics;
+    }
+    // link modules, in the order of files
+    llvm::LLVMContext context;
+    context.setDiagnosticHandlerCallBack([](const llvm::DiagnosticInfo &info, void *) {
+        // skip remarks (e.g. from code generation)
+        if (info.getSeverity() == llvm::DS_Remark || info.getSeverity() == llvm::DS_Note) {
+            return;
+        }
+        llvm::DiagnosticPrinterRawOStream printer(llvm::errs());
+        llvm::errs() << (info.getSeverity() == llvm::DS_Error ? "error: " : "warning: ");
+        info.print(printer);
+        llvm::errs() << "\n";
+    });
+    auto linked = std::make_unique<llvm::Module>(output.path, context);
+    linked -> setTargetTriple(llvm::sys::getDefaultTargetTriple());
+    llvm::Linker linker(*linked);
+    bool succeeded = true;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!results[i].succeeded) {
+            succeeded = false;
+            continue;
+        }
+        auto buffer = llvm::MemoryBufferRef(
+            llvm::StringRef(results[i].bitcode.data(), results[i].bitcode.size()), files[i]);
+        auto module = llvm::parseBitcodeFile(buffer, context);
+        if (!module) {
+            llvm::logAllUnhandledErrors(module.takeError(), llvm::errs(), files[i] + ": ");
+            succeeded = false;
+            continue;
+        }
+        // linker reports its errors (e.g. duplicate definitions) itself
+        if (linker.linkInModule(std::move(*module))) {
+            succeeded = false;
+        }
+    }
+    if (!succeeded) {
+        return false;
+    }
+    auto target_machine = create_target_machine(output, options.optimization_level);
+    if (!target_machine) {
+        return false;
+    }
+    linked -> setTargetTriple(target_machine -> getTargetTriple().str());
+    linked -> setDataLayout(target_machine -> createDataLayout());
+    // optimize across the functions of all files
+    if (options.interprocedural.enabled) {
+        llvm::TimeTraceScope trace("interprocedural optimizations");
+        for (auto &name : options.interprocedural.exports) {
+            llvm::Function *function = linked -> getFunction(name);
+            if (!function || function -> isDeclaration()) {
+                fprintf(stderr, "warning: exported function %s is not defined\n", name.c_str());
+            }
+        }
+        statistics.inlined_calls += optimizer::Optimizer::optimize_interprocedural(*linked, target_machine.get(),
+            options.optimization_level, options.interprocedural);
+    }
+    // write linked module
+    return write_output(*linked, output, target_machine.get());
+}
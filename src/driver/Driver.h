@@ -0,0 +1,42 @@
+#ifndef __DRIVER_H__
+#define __DRIVER_H__
+
+#include <string>
+#include <vector>
+#include "../session/Session.h"
+
+namespace driver {
+
+    // Format of the output file
+    enum class Emit {
+        OBJECT,   // native object file
+        ASSEMBLY, // native assembly
+        BITCODE,  // LLVM bitcode
+        IR,       // LLVM IR, as text
+    };
+
+    // Output describes the file to compile to, and the machine it targets
+    struct Output {
+        std::string path;
+        Emit emit = Emit::BITCODE;
+        // CPU to tune and select instructions for: generic if empty,
+        // the host CPU (with all of its features) if "native"
+        std::string cpu;
+    };
+
+    // Compile files to a single file at output.
+    // Files are parsed and compiled at the same time by a pool of jobs
+    // threads (0 = one per core), each with its own compiler session.
+    // Their modules are then linked together, in the order of files, and
+    // optimized across functions if options.interprocedural asks for it.
+    // Statistics of all the sessions (and of the linked module) are added to statistics.
+    // The linked module is then written as output asks for, through a target
+    // machine for the default target triple (the host) and the CPU of output.
+    // Return false if any file fails to compile or the output cannot be written.
+    bool compile_files(const std::vector<std::string> &files, unsigned jobs,
+                       const session::Options &options, const Output &output,
+                       session::Statistics &statistics);
+
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include "Cache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Modules whose identifier starts with this are cached, under the rest of it
+static const llvm::StringRef key_prefix = "kaleidoscope-cache:";
+
+// Bump when the generated code changes for the same source
+static const llvm::StringRef cache_version = "1";
+
+std::string jit::ObjectCache::get_key(const llvm::MD5::MD5Result &definition) const {
+    llvm::MD5 hash;
+    hash.update(cache_version);
+    hash.update(configuration);
+    hash.update(definition.Bytes);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    return result.digest().str().str();
+}
+
+void jit::ObjectCache::set_key(llvm::Module &module, llvm::StringRef key) {
+    module.setModuleIdentifier((key_prefix + key).str());
+}
+
+std::unique_ptr<llvm::MemoryBuffer> jit::ObjectCache::load(llvm::StringRef key) const {
+    llvm::SmallString<128> path(directory);
+    llvm::sys::path::append(path, key + ".o");
+    auto object = llvm::MemoryBuffer::getFile(path);
+    if (!object) {
+        return nullptr;
+    }
+    return std::move(*object);
+}
+
+void jit::ObjectCache::notifyObjectCompiled(const llvm::Module *module, llvm::MemoryBufferRef object) {
+    llvm::StringRef key = module -> getModuleIdentifier();
+    if (!key.consume_front(key_prefix)) {
+        return;
+    }
+    misses++;
+    // write to a temporary file, then rename, so that readers never see partial objects
+    if (llvm::sys::fs::create_directories(directory)) {
+        return;
+    }
+    llvm::SmallString<128> path(directory), temporary;
+    llvm::sys::path::append(path, key + ".o");
+    int fd;
+    if (llvm::sys::fs::createUniqueFile(path + ".%%%%%%", fd, temporary)) {
+        return;
+    }
+    {
+        llvm::raw_fd_ostream stream(fd, true);
+        stream << object.getBuffer();
+    }
+    if (llvm::sys::fs::rename(temporary, path)) {
+        llvm::sys::fs::remove(temporary);
+    }
+}
+
+std::unique_ptr<llvm::MemoryBuffer> jit::ObjectCache::getObject(const llvm::Module *module) {
+    llvm::StringRef key = module -> getModuleIdentifier();
+    if (!key.consume_front(key_prefix)) {
+        return nullptr;
+    }
+    return load(key);
+}
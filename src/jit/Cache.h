@@ -0,0 +1,49 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <atomic>
+#include <string>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+namespace jit {
+
+    // ObjectCache keeps the object code of function definitions on disk,
+    // one file per definition, named after a key that hashes its tokens (and
+    // the precedences of their operators) together with everything else the
+    // code depends on (compiler options, target). A definition whose object
+    // is cached can be loaded as is, without generating nor optimizing its
+    // code again.
+    class ObjectCache : public llvm::ObjectCache {
+
+        std::string directory;
+        std::string configuration;
+
+        // This counts the objects compiled to be cached: the cache misses
+        std::atomic<unsigned> misses{0};
+
+        public:
+            // cache objects in directory, for code compiled with configuration
+            // (a description of the options the code depends on)
+            ObjectCache(std::string directory, std::string configuration)
+                : directory(std::move(directory)), configuration(std::move(configuration)) {}
+            // key of a definition whose tokens and operator precedences hash to definition
+            std::string get_key(const llvm::MD5::MD5Result &definition) const;
+            // tag module so that its object is cached under key once compiled
+            static void set_key(llvm::Module &module, llvm::StringRef key);
+            // retrieve object cached under key, null if none
+            std::unique_ptr<llvm::MemoryBuffer> load(llvm::StringRef key) const;
+            // number of objects compiled (not found in the cache) to be cached so far
+            unsigned get_misses() const { return misses; }
+            // llvm::ObjectCache
+            void notifyObjectCompiled(const llvm::Module *module, llvm::MemoryBufferRef object) override;
+            std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *module) override;
+
+    };
+
+}
+
+#endif
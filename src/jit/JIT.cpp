@@ -0,0 +1,208 @@
+#include "JIT.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cmath>
+
+// This is called instead of an implementation that cannot be compiled
+// (e.g. it calls an undefined function), once the error is reported
+static double implementation_not_compiled() {
+    return NAN;
+}
+
+jit::KaleidoscopeJIT::KaleidoscopeJIT(
+    std::unique_ptr<llvm::orc::LLJIT> lljit,
+    std::unique_ptr<llvm::orc::LazyCallThroughManager> call_through_manager,
+    std::unique_ptr<llvm::orc::IndirectStubsManager> stubs_manager
+) : lljit(std::move(lljit)), call_through_manager(std::move(call_through_manager)),
+    stubs_manager(std::move(stubs_manager)) {
+    set_error_reporter([](llvm::Error error) {
+        llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "JIT session error: ");
+    });
+    this -> lljit -> getExecutionSession().setErrorReporter([this](llvm::Error error) {
+        // a call whose implementation failed to materialize, which reported why already
+        error = llvm::handleErrors(std::move(error), [this](std::unique_ptr<llvm::orc::FailedToMaterialize>) {
+            failed_calls++;
+        });
+        if (error) {
+            report_error(std::move(error));
+        }
+    });
+}
+
+void jit::KaleidoscopeJIT::set_error_reporter(llvm::unique_function<void(llvm::Error)> report) {
+    report_error = std::move(report);
+}
+
+llvm::Expected<std::unique_ptr<jit::KaleidoscopeJIT>> jit::KaleidoscopeJIT::create(llvm::ObjectCache *cache) {
+    llvm::orc::LLJITBuilder builder;
+    // compile modules with the cache, if any
+    if (cache) {
+        builder.setCompileFunctionCreator([cache](llvm::orc::JITTargetMachineBuilder target_machine_builder)
+            -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+            auto target_machine = target_machine_builder.createTargetMachine();
+            if (!target_machine) {
+                return target_machine.takeError();
+            }
+            return std::make_unique<llvm::orc::TMOwningSimpleCompiler>(std::move(*target_machine), cache);
+        });
+    }
+    // create LLJIT for the host
+    auto lljit = builder.create();
+    if (!lljit) {
+        return lljit.takeError();
+    }
+    // resolve unknown symbols (externs) in the current process
+    auto process_symbols = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+        (*lljit) -> getDataLayout().getGlobalPrefix());
+    if (!process_symbols) {
+        return process_symbols.takeError();
+    }
+    (*lljit) -> getMainJITDylib().addGenerator(std::move(*process_symbols));
+    // create managers of stubs and trampolines
+    const llvm::Triple &triple = (*lljit) -> getTargetTriple();
+    auto call_through_manager = llvm::orc::createLocalLazyCallThroughManager(triple,
+        (*lljit) -> getExecutionSession(), llvm::pointerToJITTargetAddress(&implementation_not_compiled));
+    if (!call_through_manager) {
+        return call_through_manager.takeError();
+    }
+    auto stubs_manager = llvm::orc::createLocalIndirectStubsManagerBuilder(triple)();
+    // return jit
+    return std::unique_ptr<KaleidoscopeJIT>(new KaleidoscopeJIT(
+        std::move(*lljit), std::move(*call_through_manager), std::move(stubs_manager)));
+}
+
+llvm::Expected<std::unique_ptr<llvm::TargetMachine>> jit::KaleidoscopeJIT::create_target_machine() {
+    auto target_machine_builder = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!target_machine_builder) {
+        return target_machine_builder.takeError();
+    }
+    return target_machine_builder -> createTargetMachine();
+}
+
+llvm::orc::ResourceTrackerSP jit::KaleidoscopeJIT::create_resource_tracker() {
+    return lljit -> getMainJITDylib().createResourceTracker();
+}
+
+llvm::Error jit::KaleidoscopeJIT::add_module(llvm::orc::ThreadSafeModule module, llvm::orc::ResourceTrackerSP tracker) {
+    // default tracker of the main dylib if none
+    if (!tracker) {
+        tracker = lljit -> getMainJITDylib().getDefaultResourceTracker();
+    }
+    return lljit -> addIRModule(tracker, std::move(module));
+}
+
+llvm::Error jit::KaleidoscopeJIT::add_function_module(llvm::orc::ThreadSafeModule module,
+    llvm::StringRef function, llvm::StringRef implementation) {
+    return add_implementation(function, implementation, [&](llvm::orc::ResourceTrackerSP tracker) {
+        return lljit -> addIRModule(tracker, std::move(module));
+    });
+}
+
+llvm::Error jit::KaleidoscopeJIT::add_function_object(std::unique_ptr<llvm::MemoryBuffer> object,
+    llvm::StringRef function, llvm::StringRef implementation) {
+    return add_implementation(function, implementation, [&](llvm::orc::ResourceTrackerSP tracker) {
+        return lljit -> addObjectFile(tracker, std::move(object));
+    });
+}
+
+namespace {
+
+    // GeneratorMaterializationUnit defines an implementation whose module
+    // is generated only when the implementation is materialized
+    class GeneratorMaterializationUnit : public llvm::orc::MaterializationUnit {
+
+        llvm::orc::IRLayer &layer;
+        jit::KaleidoscopeJIT::ModuleGenerator generate;
+
+        public:
+            GeneratorMaterializationUnit(llvm::orc::IRLayer &layer, jit::KaleidoscopeJIT::ModuleGenerator generate,
+                llvm::orc::SymbolStringPtr implementation)
+                : MaterializationUnit(Interface(
+                    { { implementation, llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable } }, nullptr)),
+                  layer(layer), generate(std::move(generate)) {}
+            llvm::StringRef getName() const override { return "GeneratorMaterializationUnit"; }
+            void materialize(std::unique_ptr<llvm::orc::MaterializationResponsibility> responsibility) override {
+                auto module = generate();
+                if (!module || !*module) {
+                    if (!module) {
+                        responsibility -> getExecutionSession().reportError(module.takeError());
+                    }
+                    responsibility -> failMaterialization();
+                    return;
+                }
+                layer.emit(std::move(responsibility), std::move(*module));
+            }
+
+        private:
+            void discard(const llvm::orc::JITDylib &, const llvm::orc::SymbolStringPtr &) override {}
+
+    };
+
+}
+
+llvm::Error jit::KaleidoscopeJIT::add_lazy_function(ModuleGenerator generate,
+    llvm::StringRef function, llvm::StringRef implementation) {
+    return add_implementation(function, implementation, [&](llvm::orc::ResourceTrackerSP tracker) {
+        return tracker -> getJITDylib().define(std::make_unique<GeneratorMaterializationUnit>(
+            lljit -> getIRTransformLayer(), std::move(generate), lljit -> mangleAndIntern(implementation)), tracker);
+    });
+}
+
+llvm::Error jit::KaleidoscopeJIT::add_implementation(llvm::StringRef function, llvm::StringRef implementation,
+    llvm::function_ref<llvm::Error(llvm::orc::ResourceTrackerSP)> add) {
+    // implementation already current
+    if (implementations.lookup(function).name == implementation) {
+        return llvm::Error::success();
+    }
+    auto tracker = create_resource_tracker();
+    if (auto error = add(tracker)) {
+        return error;
+    }
+    if (auto error = redirect(function, implementation, tracker)) {
+        return llvm::joinErrors(std::move(error), tracker -> remove());
+    }
+    return llvm::Error::success();
+}
+
+llvm::Error jit::KaleidoscopeJIT::redirect(llvm::StringRef function, llvm::StringRef implementation,
+    llvm::orc::ResourceTrackerSP tracker) {
+    auto &main = lljit -> getMainJITDylib();
+    // the stub first jumps to a trampoline compiling implementation,
+    // then straight to implementation once compiled (unless redefined meanwhile)
+    auto trampoline = call_through_manager -> getCallThroughTrampoline(main, lljit -> mangleAndIntern(implementation),
+        [this, function = function.str(), implementation = implementation.str()](llvm::JITTargetAddress address) -> llvm::Error {
+            if (implementations.lookup(function).name != implementation) {
+                return llvm::Error::success();
+            }
+            return stubs_manager -> updatePointer(function, address);
+        });
+    if (!trampoline) {
+        return trampoline.takeError();
+    }
+    auto current = implementations.find(function);
+    // first definition, define function as its stub
+    if (current == implementations.end()) {
+        auto flags = llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable;
+        if (auto error = stubs_manager -> createStub(function, *trampoline, flags)) {
+            return error;
+        }
+        auto stub = stubs_manager -> findStub(function, true);
+        if (auto error = main.define(llvm::orc::absoluteSymbols({ { lljit -> mangleAndIntern(function), stub } }))) {
+            return error;
+        }
+        implementations[function] = { implementation.str(), tracker };
+        return llvm::Error::success();
+    }
+    // redefinition, repoint stub then remove previous implementation
+    if (auto error = stubs_manager -> updatePointer(function, *trampoline)) {
+        return error;
+    }
+    auto previous = std::move(current -> second.tracker);
+    current -> second = { implementation.str(), tracker };
+    return previous -> remove();
+}
+
+llvm::Expected<llvm::JITEvaluatedSymbol> jit::KaleidoscopeJIT::lookup(llvm::StringRef name) {
+    return lljit -> lookup(name);
+}
@@ -0,0 +1,110 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include <atomic>
+#include "llvm/ADT/FunctionExtras.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/LazyReexports.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Target/TargetMachine.h"
+
+namespace jit {
+
+    // KaleidoscopeJIT compiles modules to native code for the host
+    // and resolves their symbols. It is a thin layer over ORC's LLJIT,
+    // which also makes the symbols of the current process (e.g. libm)
+    // available to JIT'd code so that externs can be called.
+    //
+    // Functions are called through stubs: a function is defined as a stub
+    // jumping to its current implementation, which lives in a module of its
+    // own under a versioned name. Redefining a function compiles the new
+    // implementation and repoints the stub, so callers are not compiled again.
+    class KaleidoscopeJIT {
+
+        // This is the implementation of a function and the tracker owning its code
+        struct Implementation {
+            std::string name;
+            llvm::orc::ResourceTrackerSP tracker;
+        };
+
+        std::unique_ptr<llvm::orc::LLJIT> lljit;
+
+        // These create the stubs of functions, and the trampolines compiling
+        // implementations on their first call
+        std::unique_ptr<llvm::orc::LazyCallThroughManager> call_through_manager;
+        std::unique_ptr<llvm::orc::IndirectStubsManager> stubs_manager;
+
+        // This maps every function defined to its current implementation
+        llvm::StringMap<Implementation> implementations;
+
+        // This counts the calls to implementations that failed to compile
+        std::atomic<unsigned> failed_calls{0};
+
+        // This reports the errors of the JIT
+        llvm::unique_function<void(llvm::Error)> report_error;
+
+        KaleidoscopeJIT(
+            std::unique_ptr<llvm::orc::LLJIT> lljit,
+            std::unique_ptr<llvm::orc::LazyCallThroughManager> call_through_manager,
+            std::unique_ptr<llvm::orc::IndirectStubsManager> stubs_manager
+        );
+
+        // point stub of function to implementation, whose code tracker owns
+        llvm::Error redirect(llvm::StringRef function, llvm::StringRef implementation, llvm::orc::ResourceTrackerSP tracker);
+        // add implementation of function with add (given the tracker to own its code), then redirect
+        llvm::Error add_implementation(llvm::StringRef function, llvm::StringRef implementation,
+            llvm::function_ref<llvm::Error(llvm::orc::ResourceTrackerSP)> add);
+
+        public:
+            // This generates a module defining an implementation, when first called
+            // (an empty module if it failed, having reported why)
+            typedef llvm::unique_function<llvm::Expected<llvm::orc::ThreadSafeModule>()> ModuleGenerator;
+
+            // create a JIT targeting the host machine,
+            // notifying cache (if any) of the objects it compiles
+            static llvm::Expected<std::unique_ptr<KaleidoscopeJIT>> create(llvm::ObjectCache *cache = nullptr);
+            // Report the errors of the JIT with report, instead of printing them to stderr.
+            // A call to an implementation that fails to compile evaluates to NaN: its error
+            // is reported (once), and the call counted as failed.
+            void set_error_reporter(llvm::unique_function<void(llvm::Error)> report);
+            // number of calls to implementations that failed to compile so far
+            unsigned get_failed_calls() const { return failed_calls; }
+            // data layout modules must use to be added to this JIT
+            const llvm::DataLayout &get_data_layout() const { return lljit -> getDataLayout(); }
+            // create a target machine for the host, as the one compiling modules
+            static llvm::Expected<std::unique_ptr<llvm::TargetMachine>> create_target_machine();
+            // create a tracker that owns the resources of the modules added with it,
+            // so that they can be removed from the JIT all at once
+            llvm::orc::ResourceTrackerSP create_resource_tracker();
+            // add module to the JIT, tracked by tracker if given
+            llvm::Error add_module(llvm::orc::ThreadSafeModule module, llvm::orc::ResourceTrackerSP tracker = nullptr);
+            // Add module defining implementation of function, and call it from now on
+            // instead of the previous implementation of function (whose code is removed).
+            // Nothing is done if implementation is the current one already.
+            llvm::Error add_function_module(llvm::orc::ThreadSafeModule module,
+                llvm::StringRef function, llvm::StringRef implementation);
+            // same as add_function_module, for an object file compiled before (e.g. cached)
+            llvm::Error add_function_object(std::unique_ptr<llvm::MemoryBuffer> object,
+                llvm::StringRef function, llvm::StringRef implementation);
+            // Same as add_function_module, but the module is only generated (then compiled)
+            // when implementation is first called. Generation runs on the thread calling it.
+            llvm::Error add_lazy_function(ModuleGenerator generate,
+                llvm::StringRef function, llvm::StringRef implementation);
+            // look up a JIT'd symbol, compiling it if needed
+            llvm::Expected<llvm::JITEvaluatedSymbol> lookup(llvm::StringRef name);
+
+    };
+
+}
+
+#endif
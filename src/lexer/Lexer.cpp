@@ -1,37 +1,152 @@
 #include "Lexer.h"
 #include <cstdlib>
+#include <cstring>
 
-int lexer::current_token;
-std::string lexer::identifier;
-double lexer::number;
+bool lexer::Lexer::open_file(const std::string &path) {
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer) {
+        fprintf(stderr, "error: cannot open '%s': %s\n", path.c_str(), buffer.getError().message().c_str());
+        return false;
+    }
+    open_buffer(std::move(*buffer));
+    return true;
+}
+
+void lexer::Lexer::open_buffer(std::unique_ptr<llvm::MemoryBuffer> buffer) {
+    source = std::move(buffer);
+    cursor = source -> getBufferStart();
+    source_end = source -> getBufferEnd();
+    next_location = { 1, 1 };
+}
+
+// token of every keyword, indexed by symbol
+static const int keyword_tokens[symbols::Keyword::KEYWORDS] = {
+    lexer::Token::DEFINITION,
+    lexer::Token::EXTERN,
+    lexer::Token::IF,
+    lexer::Token::THEN,
+    lexer::Token::ELSE,
+    lexer::Token::FOR,
+    lexer::Token::IN,
+    lexer::Token::VAR,
+    lexer::Token::BINARY,
+    lexer::Token::UNARY,
+};
+
+// update position after character
+static void advance(lexer::Location &position, int character) {
+    if (character == '\n') {
+        position.line++;
+        position.column = 1;
+    } else {
+        position.column++;
+    }
+}
+
+// read a character from standard input, as an unsigned char or EOF
+// (so that it can be passed to the <cctype> functions as is)
+int lexer::Lexer::read_character() {
+    int character = getchar();
+    advance(next_location, character);
+    return character;
+}
+
+// read a number out of [start, start + length)
+static double parse_number(const char *start, size_t length) {
+    // strtod needs a terminated string, copy to the stack unless huge
+    char digits[64];
+    if (length < sizeof(digits)) {
+        memcpy(digits, start, length);
+        digits[length] = '\0';
+        return strtod(digits, 0);
+    }
+    return strtod(std::string(start, length).c_str(), 0);
+}
+
+// The buffered lexer is the same state machine as the one
+// reading standard input, but it scans the source buffer in place.
+int lexer::Lexer::get_buffered_token() {
+    // skip whitespaces and comments
+    while (cursor != source_end) {
+        if (isspace((unsigned char) *cursor)) {
+            advance(next_location, *cursor++);
+        } else if (*cursor == '#') {
+            while (cursor != source_end && *cursor != '\n' && *cursor != '\r') {
+                advance(next_location, *cursor++);
+            }
+        } else {
+            break;
+        }
+    }
+
+    location = next_location;
+
+    // EOF
+    if (cursor == source_end) {
+        return Token::END_OF_FILE;
+    }
+
+    const char *start = cursor;
+
+    // Alphanumerics (DEF, EXTERN, IDENTIFIER)
+    if (isalpha((unsigned char) *cursor)) {
+        while (++cursor != source_end && isalnum((unsigned char) *cursor));
+        next_location.column += cursor - start;
+        identifier = std::string_view(start, cursor - start);
+        symbol = symbol_table.intern(llvm::StringRef(start, cursor - start));
+        // Keywords
+        if (symbol < symbols::Keyword::KEYWORDS) {
+            return keyword_tokens[symbol];
+        }
+        // Identifier
+        return Token::IDENTIFIER;
+    }
+
+    // Numbers
+    if (isdigit((unsigned char) *cursor) || *cursor == '.') {
+        while (++cursor != source_end && (isdigit((unsigned char) *cursor) || *cursor == '.'));
+        next_location.column += cursor - start;
+        number = parse_number(start, cursor - start);
+        // Number
+        return Token::NUMBER;
+    }
+
+    // Others [0-255]
+    advance(next_location, *cursor);
+    return (unsigned char) *cursor++;
+}
 
 // The actual implementation of the lexer is a single function
 // get_current_token(). It's called to return the next token from standard input
 // get_current_token() works by invoking the getchar() function to 
 // read characters one at a time. Then, it recognizes these and stores 
 // the last character in last_character.
-int lexer::get_current_token() {
-    static int last_character = ' ';
+// If a source file has been opened, tokens are read from it instead.
+int lexer::Lexer::get_current_token() {
+    if (source) {
+        return get_buffered_token();
+    }
 
     // The first thing that we need to 
     // do is to ignore whitespaces between tokens
     while (isspace(last_character)) {
-        last_character = getchar();
+        last_character = read_character();
     }
 
+    // The character just read is the first one of the token
+    location = { next_location.line, next_location.column - 1 };
+
     // Alphanumerics (DEF, EXTERN, IDENTIFIER)
     if (isalpha(last_character)) {
-        identifier = last_character;
-        while (isalnum(last_character = getchar())) {
-            identifier += last_character;
-        }
-        // Def
-        if (identifier == "def") {
-            return DEFINITION;
+        identifier_storage = last_character;
+        while (isalnum(last_character = read_character())) {
+            identifier_storage += last_character;
         }
-        // Extern
-        if (identifier == "extern") {
-            return EXTERN;
+        identifier = identifier_storage;
+        symbol = symbol_table.intern(identifier_storage);
+        // Keywords
+        if (symbol < symbols::Keyword::KEYWORDS) {
+            return keyword_tokens[symbol];
         }
         // Identifier
         return IDENTIFIER;
@@ -42,7 +157,7 @@ int lexer::get_current_token() {
         std::string number_string;
         number_string += last_character;
         
-        while (isdigit(last_character = getchar()) || last_character == '.') {
+        while (isdigit(last_character = read_character()) || last_character == '.') {
             number_string += last_character;
         }
         number = strtod(number_string.c_str(), 0);
@@ -52,11 +167,11 @@ int lexer::get_current_token() {
 
     // Comments/EOF
     if (last_character == '#') {
-        while ((last_character = getchar()) != EOF 
+        while ((last_character = read_character()) != EOF 
                 && last_character != '\n' 
                 && last_character != '\r');
-        if (last_character == EOF) {
-            return END_OF_FILE;
+        if (last_character != EOF) {
+            return get_current_token();
         }
     }
 
@@ -67,10 +182,86 @@ int lexer::get_current_token() {
 
     // Others [0-255]
     int this_character = last_character;
-    last_character = getchar();
+    last_character = read_character();
     return this_character;
 }
 
-int lexer::get_next_token() {
+// hash current token, as it is about to be consumed
+void lexer::Lexer::hash_current_token() {
+    hash.update(llvm::ArrayRef<uint8_t>((const uint8_t *) &current_token, sizeof(current_token)));
+    switch (current_token) {
+        case DEFINITION:
+        case EXTERN:
+        case IDENTIFIER:
+            // separate identifiers, so that "ab c" and "a bc" differ
+            hash.update(llvm::StringRef(identifier.data(), identifier.size()));
+            hash.update(llvm::ArrayRef<uint8_t>((const uint8_t *) "", 1));
+            break;
+        case NUMBER:
+            hash.update(llvm::ArrayRef<uint8_t>((const uint8_t *) &number, sizeof(number)));
+            break;
+        default:
+            // tokens other than characters are negative, past the end of the set as unsigned
+            if ((unsigned) current_token < hashed_characters.size()) {
+                hashed_characters.set(current_token);
+            }
+    }
+}
+
+int lexer::Lexer::get_next_token() {
+    if (hashing) {
+        hash_current_token();
+    }
+    tokens_read++;
     return current_token = get_current_token();
-}
\ No newline at end of file
+}
+
+// true if token starts a top level item (or ends the input)
+static bool is_boundary(int token) {
+    return token == lexer::Token::DEFINITION || token == lexer::Token::EXTERN
+        || token == ';' || token == lexer::Token::END_OF_FILE;
+}
+
+int lexer::Lexer::synchronize() {
+    if (is_boundary(current_token)) {
+        return current_token;
+    }
+    // standard input is read a character at a time anyway
+    if (!source) {
+        while (!is_boundary(get_next_token()));
+        return current_token;
+    }
+    // look for ';' or the words def and extern, without interning identifiers
+    while (cursor != source_end && *cursor != ';') {
+        if (isalpha((unsigned char) *cursor)) {
+            const char *start = cursor;
+            while (++cursor != source_end && isalnum((unsigned char) *cursor));
+            llvm::StringRef word(start, cursor - start);
+            if (word == "def" || word == "extern") {
+                cursor = start;
+                break;
+            }
+            next_location.column += cursor - start;
+        } else if (*cursor == '#') {
+            while (cursor != source_end && *cursor != '\n' && *cursor != '\r') {
+                advance(next_location, *cursor++);
+            }
+        } else {
+            advance(next_location, *cursor++);
+        }
+    }
+    return get_next_token();
+}
+
+void lexer::Lexer::start_hash() {
+    hash = llvm::MD5();
+    hashed_characters.reset();
+    hashing = true;
+}
+
+llvm::MD5::MD5Result lexer::Lexer::finish_hash() {
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    hashing = false;
+    return result;
+}
@@ -1,27 +1,109 @@
 #ifndef __LEXER_H__
 #define __LEXER_H__
 
+#include <bitset>
 #include <string>
+#include <string_view>
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "../symbols/Symbols.h"
 
 namespace lexer {
 
-    // Provides a simple token buffer
-    // CurrentToken is the current token the parser is looking at.
-    // GetNextToken reads another token  from the lexer and updates 
-    // the CurrentToken with its results.
-    extern int current_token;
-    // retrieve current token
-    int get_current_token();
-    // retrieve next token
-    int get_next_token();
+    // Position of a token in the source (1-based)
+    struct Location {
+        unsigned line;
+        unsigned column;
+    };
+
+    // Lexer splits its input into tokens. It reads standard input
+    // one character at a time, unless a source file is opened:
+    // the whole file is then memory-mapped (or read in one go),
+    // and tokens are sliced out of it without copies.
+    class Lexer {
+
+        // This interns every identifier read
+        symbols::SymbolTable &symbol_table;
+
+        // This is the source file, if any, and the lexer position in it
+        std::unique_ptr<llvm::MemoryBuffer> source;
+        const char *cursor = nullptr;
+        const char *source_end = nullptr;
+
+        // This is the position of the next character to be read
+        Location next_location = { 1, 1 };
+
+        // This holds identifiers read from standard input
+        std::string identifier_storage;
+
+        // This is the last character read from standard input
+        int last_character = ' ';
+
+        // This hashes the tokens consumed since start_hash(), if hashing
+        llvm::MD5 hash;
+        bool hashing = false;
+
+        // This tells which characters were among the tokens hashed
+        std::bitset<256> hashed_characters;
+
+        int read_character();
+        int get_buffered_token();
+        void hash_current_token();
 
-    // If the current token is an IDENTIFIER
-    // Identifier will hold its value 
-    extern std::string identifier;
+        public:
+            Lexer(symbols::SymbolTable &symbol_table)
+                : symbol_table(symbol_table) {}
 
-    // If the current token is a NUMBER
-    // Number will hold its value
-    extern double number;
+            // Provides a simple token buffer
+            // CurrentToken is the current token the parser is looking at.
+            // GetNextToken reads another token  from the lexer and updates 
+            // the CurrentToken with its results.
+            int current_token;
+
+            // If the current token is an IDENTIFIER
+            // Identifier will hold its value. It is a view into the
+            // source buffer, valid until the next token is read
+            std::string_view identifier;
+
+            // If the current token is an IDENTIFIER
+            // Symbol will hold its interned symbol
+            symbols::Symbol symbol;
+
+            // If the current token is a NUMBER
+            // Number will hold its value
+            double number;
+
+            // Location will hold the position of the current token
+            Location location = { 1, 1 };
+
+            // This counts the tokens read so far
+            unsigned tokens_read = 0;
+
+            // Read tokens from file instead of standard input.
+            // Return false if the file cannot be opened.
+            bool open_file(const std::string &path);
+            // Read tokens from buffer instead of standard input
+            void open_buffer(std::unique_ptr<llvm::MemoryBuffer> buffer);
+            // name of the input, to report errors in
+            llvm::StringRef get_source_name() const {
+                return source ? source -> getBufferIdentifier() : "<stdin>";
+            }
+            // retrieve current token
+            int get_current_token();
+            // retrieve next token
+            int get_next_token();
+            // Skip to the next top level item after an error: to the next
+            // def, extern or ';' (the current token if it is one), or the end
+            // of the input. Source files are scanned without making tokens.
+            int synchronize();
+            // Hash the tokens consumed from now on, current token included,
+            // until finish_hash() returns their hash (e.g. to identify a definition)
+            void start_hash();
+            llvm::MD5::MD5Result finish_hash();
+            // Characters among the tokens of the last hash (e.g. the operators it depends on)
+            const std::bitset<256> &get_hashed_characters() const { return hashed_characters; }
+
+    };
 
     // The lexer returns tokens [0-255] if it is an
     // unknown character, otherwise one of these
@@ -32,9 +114,19 @@ namespace lexer {
         EXTERN      = -3, // extern
         IDENTIFIER  = -4, // identifier
         NUMBER      = -5, //number 
+        // control flow
+        IF          = -6, // if
+        THEN        = -7, // then
+        ELSE        = -8, // else
+        FOR         = -9, // for
+        IN          = -10, // in
+        // variables
+        VAR         = -11, // var
+        // operators defined by the input
+        BINARY      = -12, // binary
+        UNARY       = -13, // unary
     };
 
 }
 
 #endif
-
@@ -1,16 +1,77 @@
 #include "Logger.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+#include "../session/Session.h"
 
-std::unique_ptr<ast::Expression> logger::log_expression_error(const char *error) {
-    fprintf(stderr, "LogError: %s\n", error);
+// print diagnostic of severity at location of file (if any), in one write,
+// so that diagnostics of different threads do not interleave
+static void print_diagnostic(session::CompilerSession &session, const char *severity,
+    llvm::StringRef file, const lexer::Location *location, llvm::StringRef message) {
+    std::string diagnostic;
+    llvm::raw_string_ostream stream(diagnostic);
+    if (session.options.diagnostics.format == logger::Format::JSON) {
+        llvm::json::OStream json(stream);
+        json.object([&] {
+            if (!file.empty()) {
+                json.attribute("file", file);
+            }
+            if (location) {
+                json.attribute("line", location -> line);
+                json.attribute("column", location -> column);
+            }
+            json.attribute("severity", severity);
+            json.attribute("message", message);
+        });
+    } else {
+        if (!file.empty()) {
+            stream << file << ":";
+            if (location) {
+                stream << location -> line << ":" << location -> column << ":";
+            }
+            stream << " ";
+        }
+        stream << severity << ": " << message;
+    }
+    stream << "\n";
+    fputs(stream.str().c_str(), stderr);
+}
+
+// count error, print it at location of file (if any) unless past the error limit
+static void report_error(session::CompilerSession &session, llvm::StringRef file, const lexer::Location *location,
+    llvm::StringRef error) {
+    unsigned errors = ++session.errors;
+    unsigned max_errors = session.options.diagnostics.max_errors;
+    if (max_errors && errors > max_errors) {
+        return;
+    }
+    print_diagnostic(session, "error", file, location, error);
+    if (errors == max_errors) {
+        print_diagnostic(session, "fatal error", file, nullptr,
+            "too many errors emitted, stopping now (-max-errors=" + std::to_string(max_errors) + ")");
+    }
+}
+
+ast::Expression *logger::log_expression_error(session::CompilerSession &session, const char *error) {
+    report_error(session, session.lexer.get_source_name(), &session.lexer.location, error);
     return nullptr;
 }
 
-std::unique_ptr<ast::FunctionDeclaration> logger::log_function_declaration_error(const char *error) {
-    log_expression_error(error);
+ast::FunctionDeclaration *logger::log_function_declaration_error(session::CompilerSession &session, const char *error) {
+    log_expression_error(session, error);
     return nullptr;
 }
 
-llvm::Value *logger::log_value_error(const char *error) {
-    log_expression_error(error);
+llvm::Value *logger::log_value_error(session::CompilerSession &session, const char *error) {
+    llvm::StringRef file = session.item_source.empty() ? session.lexer.get_source_name() : session.item_source;
+    report_error(session, file, &session.item_location, error);
     return nullptr;
-}
\ No newline at end of file
+}
+
+bool logger::log_error(session::CompilerSession &session, llvm::Error error) {
+    if (!error) {
+        return false;
+    }
+    // the error tells what it is about (e.g. a file), not the input
+    report_error(session, "", nullptr, llvm::toString(std::move(error)));
+    return true;
+}
@@ -3,13 +3,33 @@
 
 #include "../ast/AST.h"
 #include "llvm/IR/Value.h"
+#include "llvm/Support/Error.h"
 
 namespace logger {
 
-    std::unique_ptr<ast::Expression> log_expression_error(const char *error);
-    std::unique_ptr<ast::FunctionDeclaration> log_function_declaration_error(const char *error);
-    llvm::Value *log_value_error(const char *error);
+    // Format of the diagnostics printed to stderr
+    enum class Format {
+        // file:line:column: error: message
+        TEXT,
+        // one JSON object per line, for tools
+        JSON,
+    };
+
+    // Options of the diagnostics of a session, set from the command line
+    struct DiagnosticOptions {
+        Format format = Format::TEXT;
+        // errors after which the input is no longer read (0 = no limit)
+        unsigned max_errors = 0;
+    };
+
+    // Errors of the parser are reported at the current token,
+    // errors of code generation at the top level item being generated
+    ast::Expression *log_expression_error(session::CompilerSession &session, const char *error);
+    ast::FunctionDeclaration *log_function_declaration_error(session::CompilerSession &session, const char *error);
+    llvm::Value *log_value_error(session::CompilerSession &session, const char *error);
+    // log error (e.g. from the JIT) if any, return whether there was one
+    bool log_error(session::CompilerSession &session, llvm::Error error);
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,108 +1,897 @@
-// include utils
-#include "utils/Utils.h"
+// include session
+#include "session/Session.h"
 
 // include lexer
 #include "lexer/Lexer.h"
 
-// include ast
-// #include "ast/BinaryExpression.h"
-// #include "ast/Expression.h"
-// #include "ast/FunctionDefinition.h"
-// #include "ast/FunctionCall.h"
-// #include "ast/FunctionPrototype.h"
-// #include "ast/NumberLiteral.h"
-// #include "ast/VariableReference.h"
-
 // include logger
 #include "logger/Logger.h"
 
 // include parser
 #include "parser/Parser.h"
 
+// include batch
+#include "batch/Batch.h"
+
+// include bundle
+#include "bundle/Bundle.h"
+
+// include jit
+#include "jit/Cache.h"
+#include "jit/JIT.h"
+
+// include optimizer
+#include "optimizer/Optimizer.h"
+
+// include driver
+#include "driver/Driver.h"
+
+// include profiler
+#include "profiler/Profiler.h"
+
+// include pipeline
+#include "pipeline/Pipeline.h"
+
+#include <chrono>
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/TimeProfiler.h"
+
 using namespace llvm;
 
-static void handle_function_definition() {
-  if (auto ast = parser::parse_function_definition()) {
-    if (auto *ir = ast -> codegen()) {
-      fprintf(stderr, "Parsed a function definition:");
-      ir -> print(errs());
-      fprintf(stderr, "\n");
+// This is the JIT that compiles and runs the generated modules
+static std::unique_ptr<jit::KaleidoscopeJIT> kaleidoscope_jit;
+
+// This keeps the object code of definitions across runs, if enabled
+static std::unique_ptr<jit::ObjectCache> object_cache;
+
+// This is the host, that the JIT compiles for, as the optimizer sees it
+static std::unique_ptr<TargetMachine> target_machine;
+
+// This aborts the process when the JIT reports an error
+static ExitOnError exit_on_error;
+
+// This groups the options of the Kaleidoscope JIT in --help
+static cl::OptionCategory kaleidoscope_category("Kaleidoscope options");
+
+// This selects the optimization level (-O0, -O1, -O2, -O3)
+static cl::opt<unsigned> optimization_level(
+  "O", cl::desc("Optimization level [0-3] (default = 2)"),
+  cl::Prefix, cl::init(2), cl::cat(kaleidoscope_category));
+
+// These relax floating point semantics, for simplification and code generation
+static cl::opt<bool> fast_math(
+  "fast-math", cl::desc("Allow all the floating point relaxations below"),
+  cl::cat(kaleidoscope_category));
+
+static cl::opt<bool> no_signed_zeros(
+  "no-signed-zeros", cl::desc("Allow ignoring the sign of floating point zeros"),
+  cl::cat(kaleidoscope_category));
+
+static cl::opt<bool> finite_math_only(
+  "finite-math-only", cl::desc("Assume floating point values are never NaN nor infinite"),
+  cl::cat(kaleidoscope_category));
+
+static cl::opt<bool> associative_math(
+  "associative-math", cl::desc("Allow reassociating floating point operations"),
+  cl::cat(kaleidoscope_category));
+
+// This prints what the compiler did on exit
+static cl::opt<bool> print_stats(
+  "print-stats", cl::desc("Print compilation statistics on exit"),
+  cl::cat(kaleidoscope_category));
+
+// These instrument compilation
+static cl::opt<bool> time_report(
+  "time-report", cl::desc("Report the wall and CPU time of every phase of compilation, with counters"),
+  cl::cat(kaleidoscope_category));
+
+static cl::opt<std::string> time_trace(
+  "time-trace", cl::desc("Write a trace of the phases of compilation to <filename> (Chrome trace event format)"),
+  cl::value_desc("filename"), cl::cat(kaleidoscope_category));
+
+// These are the source files to read, standard input if none or "-"
+static cl::list<std::string> input_files(
+  cl::Positional, cl::desc("<input files>"), cl::cat(kaleidoscope_category));
+
+// This is the file to compile the input files to, instead of running them
+static cl::opt<std::string> output_file(
+  "o", cl::desc("Compile input files to <filename> instead of running them"),
+  cl::value_desc("filename"), cl::cat(kaleidoscope_category));
+
+// This is the format of the file to compile to
+static cl::opt<driver::Emit> emit(
+  "emit", cl::desc("Format of the file to compile to (implies compiling)"),
+  cl::values(
+    clEnumValN(driver::Emit::OBJECT, "obj", "native object file"),
+    clEnumValN(driver::Emit::ASSEMBLY, "asm", "native assembly"),
+    clEnumValN(driver::Emit::BITCODE, "bc", "LLVM bitcode (default)"),
+    clEnumValN(driver::Emit::IR, "ll", "LLVM IR")),
+  cl::init(driver::Emit::BITCODE), cl::cat(kaleidoscope_category));
+
+// These select the CPU to compile for, "native" for the host CPU
+static cl::opt<std::string> march(
+  "march", cl::desc("Compile for <cpu> (e.g. native, x86-64-v3), as -mcpu"),
+  cl::value_desc("cpu"), cl::cat(kaleidoscope_category));
+
+static cl::opt<std::string> mcpu(
+  "mcpu", cl::desc("Compile for <cpu> (e.g. native, skylake), generic by default"),
+  cl::value_desc("cpu"), cl::cat(kaleidoscope_category));
+
+// This is the number of files compiled at the same time with -o
+static cl::opt<unsigned> jobs(
+  "j", cl::desc("Number of files to compile at the same time (default = 0, one per core)"),
+  cl::Prefix, cl::init(0), cl::cat(kaleidoscope_category));
+
+// These optimize the compiled module across its functions
+static cl::opt<bool> ipo(
+  "ipo", cl::desc("Optimize across functions when compiling (IPSCCP, inlining, global DCE)"),
+  cl::cat(kaleidoscope_category));
+
+static cl::opt<unsigned> inline_limit(
+  "inline-limit", cl::desc("Inline call sites whose callee costs less than <n> with -ipo (default = 0, by optimization level)"),
+  cl::value_desc("n"), cl::init(0), cl::cat(kaleidoscope_category));
+
+static cl::opt<unsigned> size_level(
+  "size-level", cl::desc("Optimize for size with -ipo: 0 = speed (default), 1 = size, 2 = minimum size"),
+  cl::init(0), cl::cat(kaleidoscope_category));
+
+static cl::list<std::string> exports(
+  "export", cl::desc("Export only <function>s with -ipo: the others may be removed once inlined"),
+  cl::value_desc("function"), cl::CommaSeparated, cl::cat(kaleidoscope_category));
+
+// These overlap parsing with compiling and running, for large inputs
+static cl::opt<bool> pipelined(
+  "pipeline", cl::desc("Parse the input on a thread of its own while the items before are compiled and run"),
+  cl::cat(kaleidoscope_category));
+
+static cl::opt<unsigned> pipeline_depth(
+  "pipeline-depth", cl::desc("Number of items parsing may get ahead with -pipeline (default = 64)"),
+  cl::init(64), cl::cat(kaleidoscope_category));
+
+// These control how errors are reported
+static cl::opt<logger::Format> diagnostics_format(
+  "diagnostics-format", cl::desc("Format of the errors printed to stderr"),
+  cl::values(
+    clEnumValN(logger::Format::TEXT, "text", "file:line:column: error: message (default)"),
+    clEnumValN(logger::Format::JSON, "json", "one JSON object per line, with file, line, column, severity and message")),
+  cl::init(logger::Format::TEXT), cl::cat(kaleidoscope_category));
+
+static cl::opt<unsigned> max_errors(
+  "max-errors", cl::desc("Stop reading the input after <n> errors (default = 20, 0 = no limit; no limit at the prompt unless given)"),
+  cl::value_desc("n"), cl::init(20), cl::cat(kaleidoscope_category));
+
+// These run scripts parsed ahead of time (see bundle/Bundle.h), without lexing nor parsing them
+static cl::opt<std::string> write_bundle(
+  "write-bundle", cl::desc("Parse the input files (default = standard input) into bundle <filename> instead of running them"),
+  cl::value_desc("filename"), cl::cat(kaleidoscope_category));
+
+static cl::opt<std::string> load_bundle(
+  "load", cl::desc("Run the items of <bundle>, written by -write-bundle, then the input file if any"),
+  cl::value_desc("bundle"), cl::cat(kaleidoscope_category));
+
+// This is the directory to cache the object code of definitions in
+static cl::opt<std::string> cache_directory(
+  "cache-dir", cl::desc("Cache the object code of function definitions in <directory>"),
+  cl::value_desc("directory"), cl::cat(kaleidoscope_category));
+
+// This defers code generation of definitions to their first call
+static cl::opt<bool> lazy(
+  "lazy", cl::desc("Generate and compile function definitions on their first call"),
+  cl::cat(kaleidoscope_category));
+
+// These apply a function to every row of a file, instead of running the input
+static cl::opt<std::string> batch_function(
+  "batch", cl::desc("Apply function <name> to every row of the batch input, once the input files are read"),
+  cl::value_desc("name"), cl::cat(kaleidoscope_category));
+
+static cl::opt<std::string> batch_input(
+  "batch-input", cl::desc("Read the arguments of the batch function from <filename> (default = standard input)"),
+  cl::value_desc("filename"), cl::init("-"), cl::cat(kaleidoscope_category));
+
+static cl::opt<std::string> batch_output(
+  "batch-output", cl::desc("Write the results of the batch function to <filename> (default = standard output)"),
+  cl::value_desc("filename"), cl::init("-"), cl::cat(kaleidoscope_category));
+
+static cl::opt<unsigned> vector_width(
+  "vector-width", cl::desc("Run the batch function on vectors of <N> rows (default = 0, widest for the host CPU; 1 = no vectors)"),
+  cl::value_desc("N"), cl::init(0), cl::cat(kaleidoscope_category));
+
+enum BatchFormat { CSV, BINARY };
+
+static cl::opt<BatchFormat> batch_format(
+  "batch-format", cl::desc("Format of the batch input and output"),
+  cl::values(
+    clEnumValN(CSV, "csv", "one row per line, comma separated arguments (default)"),
+    clEnumValN(BINARY, "binary", "native doubles, column after column (one result column)")),
+  cl::init(CSV), cl::cat(kaleidoscope_category));
+
+// These are library functions that Kaleidoscope code can declare extern
+// and call, e.g. to show progress in loops (the executable exports them)
+
+// print character c to stderr, return 0
+extern "C" double putchard(double c) {
+  fputc((char) c, stderr);
+  return 0;
+}
+
+// print x to stderr on a line of its own, return 0
+extern "C" double printd(double x) {
+  fprintf(stderr, "%f\n", x);
+  return 0;
+}
+
+// This tells whether to prompt for input (reading from standard input)
+static bool interactive = true;
+
+// print prompt when interactive
+static void prompt() {
+  if (interactive) {
+    fprintf(stderr, "> ");
+  }
+}
+
+// create a new module for the next top level item
+static void initialize_module(session::CompilerSession &session) {
+  session.initialize_module();
+  session.module -> setDataLayout(kaleidoscope_jit -> get_data_layout());
+}
+
+// hand current module over to the JIT and start a new one
+static void add_module(session::CompilerSession &session, orc::ResourceTrackerSP tracker = nullptr) {
+  auto module = orc::ThreadSafeModule(std::move(session.module), std::move(session.context));
+  exit_on_error(kaleidoscope_jit -> add_module(std::move(module), tracker));
+  initialize_module(session);
+}
+
+// This counts the definitions compiled, to version their implementations
+static unsigned definitions = 0;
+
+// This names the functions inlined into the definitions compiled (operators):
+// they cannot be redefined, the definitions would not call the new ones
+static StringSet<> inlined_functions;
+
+// undo the operator a definition that failed defines (if any), see
+// CompilerSession::undefine_operator, unless the items after it were
+// parsed with the operator already (-pipeline parses ahead)
+static void undefine_operator(session::CompilerSession &session, const ast::FunctionDeclaration &declaration,
+  const ast::FunctionDeclaration *previous_declaration) {
+  if (!pipelined) {
+    session.undefine_operator(declaration, previous_declaration);
+  }
+}
+
+// generate code for definition in a module of its own, defining implementation
+static orc::ThreadSafeModule generate_definition(session::CompilerSession &session,
+  const ast::Unit<ast::FunctionDefinition> &ast, const std::string &key, const std::string &implementation) {
+  {
+    profiler::Scope scope(session.profiler.get(), profiler::SIMPLIFY, implementation);
+    session.simplify(ast);
+  }
+  llvm::Function *ir;
+  {
+    profiler::Scope scope(session.profiler.get(), profiler::CODEGEN, implementation);
+    ir = ast -> codegen(session);
+  }
+  if (!ir) {
+    return {};
+  }
+  ir -> setName(implementation);
+  {
+    profiler::Scope scope(session.profiler.get(), profiler::PRINT, implementation);
+    fprintf(stderr, "Parsed a function definition:");
+    ir -> print(errs());
+    fprintf(stderr, "\n");
+  }
+  // cache object code once compiled, unless it inlines code of other definitions
+  // (operators): the input of another run may define them differently
+  bool inlines_definitions = false;
+  for (const Function &function : *session.module) {
+    if (function.hasAvailableExternallyLinkage()) {
+      inlined_functions.insert(function.getName());
+      inlines_definitions = true;
     }
-  } else {
-    // skip token for error recovery
-    lexer::get_next_token();
   }
+  if (object_cache && !inlines_definitions) {
+    jit::ObjectCache::set_key(*session.module, key);
+  }
+  auto module = orc::ThreadSafeModule(std::move(session.module), std::move(session.context));
+  initialize_module(session);
+  return module;
 }
 
-static void handle_extern_function() {
-  if (auto ast = parser::parse_extern_function()) {
-    if (auto *ir = ast -> codegen()) {
-      fprintf(stderr, "Parsed an extern function:");
-      ir -> print(errs());
-      fprintf(stderr, "\n");
+// This is a top level item parsed, that code is to be generated for
+struct Item {
+  // definition (or top level expression), or extern declaration
+  ast::Unit<ast::FunctionDefinition> definition;
+  ast::Unit<ast::FunctionDeclaration> declaration;
+  bool top_level_expression = false;
+  // position of the item in the input, to report errors at,
+  // and its file if not the one lexed (e.g. loaded from a bundle)
+  lexer::Location location;
+  std::string file;
+  // hash of a definition (see hash_definition), if hashed, and the key
+  // of its object code in the cache (if enabled)
+  MD5::MD5Result hash;
+  std::string key;
+};
+
+// hash of the definition just parsed, whose tokens the lexer hashed: how they
+// parse also depends on the precedences of the operators among them, that the
+// input may define (or redefine) differently, so they are hashed as well
+static MD5::MD5Result hash_definition(session::CompilerSession &session) {
+  MD5::MD5Result tokens = session.lexer.finish_hash();
+  auto &characters = session.lexer.get_hashed_characters();
+  MD5 hash;
+  hash.update(tokens.Bytes);
+  for (unsigned character = 0; character < characters.size(); character++) {
+    if (characters[character]) {
+      int precedence = session.binary_operator_precedences[character];
+      hash.update(ArrayRef<uint8_t>((const uint8_t *) &character, sizeof(character)));
+      hash.update(ArrayRef<uint8_t>((const uint8_t *) &precedence, sizeof(precedence)));
+    }
+  }
+  MD5::MD5Result result;
+  hash.final(result);
+  return result;
+}
+
+// parse next top level item into item, profiling it with profiler (if any),
+// return false if there is none (';', or an error skipped for recovery)
+static bool parse_item(session::CompilerSession &session, profiler::Profiler *profiler, Item &item) {
+  item.location = session.lexer.location;
+  switch (session.lexer.current_token) {
+    case ';':
+      session.lexer.get_next_token();
+      return false;
+    case lexer::Token::DEFINITION: {
+      // hash definition tokens to look its object code up in the cache,
+      // or to write them to a bundle (that keeps hashes for the cache)
+      bool hashing = object_cache || !write_bundle.empty();
+      if (hashing) {
+        session.lexer.start_hash();
+      }
+      {
+        profiler::Scope scope(profiler, profiler::PARSE);
+        item.definition = parser::parse_function_definition(session);
+      }
+      if (hashing) {
+        item.hash = hash_definition(session);
+      }
+      if (object_cache) {
+        item.key = object_cache -> get_key(item.hash);
+      }
+      break;
     }
+    case lexer::Token::EXTERN: {
+      profiler::Scope scope(profiler, profiler::PARSE);
+      item.declaration = parser::parse_extern_function(session);
+      break;
+    }
+    default: {
+      profiler::Scope scope(profiler, profiler::PARSE);
+      item.definition = parser::parse_top_level_expression(session);
+      item.top_level_expression = true;
+      break;
+    }
+  }
+  if (!item.definition && !item.declaration) {
+    // skip the rest of the item for error recovery
+    session.lexer.synchronize();
+    return false;
+  }
+  return true;
+}
+
+static void handle_function_definition(session::CompilerSession &session, ast::Unit<ast::FunctionDefinition> ast,
+  const std::string &key) {
+  TimeTraceScope trace("definition");
+  auto *declaration = ast -> get_declaration();
+  std::string name = session.symbol_table.get_name(declaration -> get_name()).str();
+  // name the implementation apart from previous ones: callers reach it through
+  // the stub named after the function, so it can be redefined
+  std::string implementation = name + "." + (key.empty() ? std::to_string(++definitions) : key);
+  auto *previous_declaration = session.function_declarations.lookup(declaration -> get_name());
+  bool same_arity = !previous_declaration ||
+    previous_declaration -> get_arguments().size() == declaration -> get_arguments().size();
+  // definitions compiled before inlined the operator, they would keep the previous one
+  if (declaration -> is_operator() && inlined_functions.count(name)) {
+    logger::log_value_error(session, "Operator cannot be redefined once inlined into other definitions.");
+    undefine_operator(session, *declaration, previous_declaration);
+    return;
+  }
+  // load cached object code, skipping code generation and optimization
+  // (unless redeclared with another arity: code generation reports the error)
+  if (object_cache && same_arity) {
+    if (auto object = object_cache -> load(key)) {
+      // its calls were checked against the functions of the run that compiled it
+      if (!ast -> check_calls(session)) {
+        undefine_operator(session, *declaration, previous_declaration);
+        return;
+      }
+      fprintf(stderr, "Loaded a cached function definition: %s\n", name.c_str());
+      profiler::Scope scope(session.profiler.get(), profiler::JIT, implementation);
+      if (logger::log_error(session, kaleidoscope_jit -> add_function_object(std::move(object), name, implementation))) {
+        undefine_operator(session, *declaration, previous_declaration);
+      } else {
+        session.declare_function(*declaration);
+        session.define_function(ast);
+        session.statistics.cache_hits++;
+      }
+      return;
+    }
+  }
+  // record definition, generate its code when first called.
+  // That happens while a top level expression runs, after its module
+  // was handed over: the current module of the session is empty then.
+  // Operators are generated right away, as their callers inline them when
+  // generated: their errors are reported at their definition, once, and
+  // they are undone (their code is still only compiled when called).
+  if (lazy && !declaration -> is_operator()) {
+    if (!same_arity) {
+      logger::log_value_error(session, "Function redeclared with a different number of arguments.");
+      undefine_operator(session, *declaration, previous_declaration);
+      return;
+    }
+    session.declare_function(*declaration);
+    session.define_function(ast);
+    auto generate = [&session, ast = std::move(ast), key, implementation, previous_declaration,
+                     location = session.item_location, source = session.item_source]() -> Expected<orc::ThreadSafeModule> {
+      session.statistics.generated_definitions++;
+      // report errors at the definition, not at the top level expression calling it
+      auto calling_location = session.item_location;
+      auto calling_source = std::move(session.item_source);
+      session.item_location = location;
+      session.item_source = source;
+      // no module if code generation failed, its errors are reported already
+      auto module = generate_definition(session, ast, key, implementation);
+      // the operator it defines is undone, unless redefined meanwhile
+      auto *declaration = ast -> get_declaration();
+      if (!module && session.function_definitions.lookup(declaration -> get_name()).get() == ast.get()) {
+        undefine_operator(session, *declaration, previous_declaration);
+      }
+      session.item_location = calling_location;
+      session.item_source = std::move(calling_source);
+      return module;
+    };
+    profiler::Scope scope(session.profiler.get(), profiler::JIT, implementation);
+    if (logger::log_error(session, kaleidoscope_jit -> add_lazy_function(std::move(generate), name, implementation))) {
+      session.function_declarations.set(declaration -> get_name(), previous_declaration);
+      undefine_operator(session, *declaration, previous_declaration);
+    } else {
+      session.statistics.deferred_definitions++;
+    }
+    return;
+  }
+  // hand module over to the JIT, calls to the function now reach it
+  auto module = generate_definition(session, ast, key, implementation);
+  if (!module) {
+    undefine_operator(session, *declaration, previous_declaration);
+    return;
+  }
+  profiler::Scope scope(session.profiler.get(), profiler::JIT, implementation);
+  if (logger::log_error(session, kaleidoscope_jit -> add_function_module(std::move(module), name, implementation))) {
+    session.function_declarations.set(declaration -> get_name(), previous_declaration);
+    undefine_operator(session, *declaration, previous_declaration);
   } else {
-    // skip token for error recovery
-    lexer::get_next_token();
+    session.define_function(ast);
   }
 }
 
-static void handle_top_level_expression() {
-  if (auto ast = parser::parse_top_level_expression()) {
-    if (auto *ir = ast -> codegen()) {
+static void handle_extern_function(session::CompilerSession &session, const ast::Unit<ast::FunctionDeclaration> &ast) {
+  TimeTraceScope trace("extern");
+  llvm::Function *ir;
+  {
+    profiler::Scope scope(session.profiler.get(), profiler::CODEGEN);
+    ir = ast -> codegen(session);
+  }
+  if (ir) {
+    profiler::Scope scope(session.profiler.get(), profiler::PRINT);
+    fprintf(stderr, "Parsed an extern function:");
+    ir -> print(errs());
+    fprintf(stderr, "\n");
+    session.declare_function(*ast);
+  }
+}
+
+// hand anonymous module over to the JIT, compile its function to native code
+static Expected<JITEvaluatedSymbol> compile_top_level_expression(session::CompilerSession &session, orc::ResourceTrackerSP tracker) {
+  profiler::Scope scope(session.profiler.get(), profiler::JIT);
+  add_module(session, tracker);
+  return kaleidoscope_jit -> lookup("__anon_expr");
+}
+
+static void handle_top_level_expression(session::CompilerSession &session, const ast::Unit<ast::FunctionDefinition> &ast) {
+  TimeTraceScope trace("top level expression");
+  {
+    profiler::Scope scope(session.profiler.get(), profiler::SIMPLIFY);
+    session.simplify(ast);
+  }
+  llvm::Function *ir;
+  {
+    profiler::Scope scope(session.profiler.get(), profiler::CODEGEN);
+    ir = ast -> codegen(session);
+  }
+  if (ir) {
+    {
+      profiler::Scope scope(session.profiler.get(), profiler::PRINT);
       fprintf(stderr, "Read top level expression:");
       ir -> print(errs());
       fprintf(stderr, "\n");
     }
+    // track the anonymous module, so that it can be freed after running
+    auto tracker = kaleidoscope_jit -> create_resource_tracker();
+    // compile anonymous function to native code and run it
+    auto symbol = compile_top_level_expression(session, tracker);
+    if (symbol) {
+      double (*function)() = (double (*)()) (intptr_t) symbol -> getAddress();
+      double result;
+      unsigned failed_calls = kaleidoscope_jit -> get_failed_calls();
+      {
+        profiler::Scope scope(session.profiler.get(), profiler::RUN);
+        result = function();
+      }
+      // a function called could not be compiled (its errors are reported): no value
+      if (kaleidoscope_jit -> get_failed_calls() == failed_calls) {
+        fprintf(stderr, "Evaluated to %f\n", result);
+      }
+    } else {
+      logger::log_error(session, symbol.takeError());
+    }
+    // remove anonymous module from the JIT
+    exit_on_error(tracker -> remove());
+  }
+}
+
+// generate code for item, then compile it (and run it if a top level expression)
+static void handle_item(session::CompilerSession &session, Item &item) {
+  session.item_location = item.location;
+  session.item_source = item.file;
+  if (item.declaration) {
+    handle_extern_function(session, item.declaration);
+  } else if (item.top_level_expression) {
+    handle_top_level_expression(session, item.definition);
+  } else {
+    handle_function_definition(session, std::move(item.definition), item.key);
+  }
+}
+
+// apply batch function to every row of batch input, return whether it succeeded
+static bool run_batch(session::CompilerSession &session) {
+  auto kernel = batch::compile(session, *kaleidoscope_jit, batch_function);
+  if (logger::log_error(session, kernel.takeError())) {
+    return false;
+  }
+  auto columns = batch_format == BINARY
+    ? batch::Columns::read_binary(batch_input, kernel -> get_arity())
+    : batch::Columns::read_csv(batch_input, kernel -> get_arity());
+  if (logger::log_error(session, columns.takeError())) {
+    return false;
+  }
+  // run kernel over all rows at once
+  std::vector<double> results(columns -> get_rows());
+  auto start = std::chrono::steady_clock::now();
+  kernel -> run(columns -> get_columns(), results.data(), results.size());
+  auto end = std::chrono::steady_clock::now();
+  fprintf(stderr, "Evaluated %zu rows in %.3f ms\n", results.size(),
+    std::chrono::duration<double, std::milli>(end - start).count());
+  // write results
+  std::error_code error;
+  raw_fd_ostream output(batch_output, error, batch_format == BINARY ? sys::fs::OF_None : sys::fs::OF_Text);
+  if (error) {
+    errs() << "error: cannot write '" << batch_output << "': " << error.message() << "\n";
+    return false;
+  }
+  if (batch_format == BINARY) {
+    output.write((const char *) results.data(), results.size() * sizeof(double));
   } else {
-    // skip token for error recovery
-    lexer::get_next_token();
+    for (double result : results) {
+      output << format("%.17g\n", result);
+    }
+  }
+  return true;
+}
+
+// parse input files (standard input if none) into the bundle to write,
+// return whether they parsed and the bundle was written
+static bool write_items_to_bundle(session::CompilerSession &session) {
+  bundle::Writer writer(session.symbol_table);
+  std::vector<std::string> files(input_files.begin(), input_files.end());
+  if (files.empty()) {
+    files.push_back("-");
+  }
+  for (auto &file : files) {
+    if (file == "-") {
+      auto buffer = MemoryBuffer::getSTDIN();
+      if (!buffer) {
+        errs() << "error: cannot read standard input: " << buffer.getError().message() << "\n";
+        return false;
+      }
+      session.lexer.open_buffer(std::move(*buffer));
+    } else if (!session.lexer.open_file(file)) {
+      return false;
+    }
+    writer.set_file(session.lexer.get_source_name());
+    session.lexer.get_next_token();
+    while (session.lexer.current_token != lexer::Token::END_OF_FILE && !session.too_many_errors()) {
+      Item item;
+      if (!parse_item(session, session.profiler.get(), item)) {
+        continue;
+      }
+      if (item.declaration) {
+        writer.add_extern(*item.declaration, item.location);
+      } else if (item.top_level_expression) {
+        writer.add_top_level_expression(*item.definition, item.location);
+      } else {
+        writer.add_definition(*item.definition, item.hash, item.location);
+      }
+    }
+  }
+  // a bundle only holds items that parse
+  if (session.errors) {
+    errs() << "error: " << write_bundle << " not written, the input does not parse\n";
+    return false;
   }
+  return !logger::log_error(session, writer.write(write_bundle));
 }
 
-static void main_loop() {
+// run the items of the bundle to load, as if read from the input,
+// return whether the bundle was read (and not given up on errors)
+static bool run_bundle_items(session::CompilerSession &session) {
+  auto reader = bundle::Reader::open(load_bundle, session.symbol_table);
+  if (logger::log_error(session, reader.takeError())) {
+    return false;
+  }
+  bundle::Item loaded;
+  while (!session.too_many_errors()) {
+    auto read = reader -> read_item(loaded);
+    if (logger::log_error(session, read.takeError())) {
+      return false;
+    }
+    if (!*read) {
+      return true;
+    }
+    Item item;
+    item.definition = std::move(loaded.definition);
+    item.declaration = std::move(loaded.declaration);
+    item.top_level_expression = loaded.kind == bundle::ItemKind::TOP_LEVEL_EXPRESSION;
+    item.location = loaded.location;
+    item.file = loaded.file.str();
+    if (object_cache && loaded.kind == bundle::ItemKind::DEFINITION) {
+      item.key = object_cache -> get_key(loaded.hash);
+    }
+    // operators the bundle defines parse in the input after it
+    auto &arena = item.declaration ? item.declaration.get_arena() : item.definition.get_arena();
+    session.define_operator(item.declaration ? *item.declaration : *item.definition -> get_declaration());
+    session.statistics.ast_nodes += arena.get_node_count();
+    handle_item(session, item);
+  }
+  return false;
+}
+
+static void main_loop(session::CompilerSession &session) {
   while (1) {
-    fprintf(stderr, "> " );
-    switch (lexer::current_token) {
-      case lexer::Token::END_OF_FILE:
-        return;
-      case ';':
-        lexer::get_next_token();
-        break;
-      case lexer::Token::DEFINITION:
-        handle_function_definition();
-        break;
-      case lexer::Token::EXTERN:
-        handle_extern_function();
-        break;
-      default:
-        handle_top_level_expression();
-        break;
+    prompt();
+    if (session.lexer.current_token == lexer::Token::END_OF_FILE || session.too_many_errors()) {
+      return;
+    }
+    Item item;
+    if (parse_item(session, session.profiler.get(), item)) {
+      handle_item(session, item);
+    }
+  }
+}
+
+// parse items on a thread of their own while the items before them are
+// compiled and run on this one, in the order of the input
+static pipeline::Report pipelined_main_loop(session::CompilerSession &session) {
+  auto parse_items = [&session](pipeline::BoundedQueue<Item> &queue) {
+    // trace the front end too, handing its events over to the main thread once done
+    if (session.options.time_trace) {
+      timeTraceProfilerInitialize(0, "kaleidoscope");
+    }
+    while (session.lexer.current_token != lexer::Token::END_OF_FILE && !session.too_many_errors()) {
+      Item item;
+      // the profiler times this thread only, it is not shared
+      if (parse_item(session, nullptr, item)) {
+        queue.push(std::move(item));
+      }
     }
+    if (session.options.time_trace) {
+      timeTraceProfilerFinishThread();
+    }
+  };
+  // once too many errors, drain the items parsed ahead without compiling them
+  auto handle = [&session](Item &item) {
+    if (!session.too_many_errors()) {
+      handle_item(session, item);
+    }
+  };
+  return pipeline::run<Item>(pipeline_depth, parse_items, handle);
+}
+
+// write time trace, if enabled, return whether it succeeded
+static bool write_time_trace() {
+  if (time_trace.empty()) {
+    return true;
+  }
+  Error error = timeTraceProfilerWrite(time_trace, "");
+  timeTraceProfilerCleanup();
+  if (error) {
+    logAllUnhandledErrors(std::move(error), errs(), "error: cannot write time trace: ");
+    return false;
   }
+  return true;
 }
 
-static void init_binary_operator_precedences () {
-  // install standard binary operators
-  // higher value <=> higher precedence
-  parser::binary_operator_precedences['<'] = 10;
-  parser::binary_operator_precedences['+'] = 20;
-  parser::binary_operator_precedences['-'] = 20;
-  parser::binary_operator_precedences['*'] = 30; // highest precedence
+// print what session did, with the peak memory of the process
+static void print_statistics(const session::Statistics &statistics) {
+  statistics.print();
+  if (time_report) {
+    fprintf(stderr, "peak memory: %zu KB\n", profiler::get_peak_memory());
+  }
 }
 
-int main() {
-  
-  init_binary_operator_precedences();
-  
-  fprintf(stderr, "> ");
-  lexer::get_next_token();
+int main(int argc, char **argv) {
+
+  // show LLVM's own -time-passes next to our options
+  cl::Option *time_passes = cl::getRegisteredOptions()["time-passes"];
+  time_passes -> addCategory(kaleidoscope_category);
+  time_passes -> setHiddenFlag(cl::NotHidden);
+  cl::HideUnrelatedOptions(kaleidoscope_category);
+  cl::ParseCommandLineOptions(argc, argv, "Kaleidoscope JIT\n");
+  if (optimization_level > 3) {
+    errs() << argv[0] << ": invalid optimization level -O" << optimization_level << "\n";
+    return 1;
+  }
+  if (size_level > 2) {
+    errs() << argv[0] << ": invalid size level " << size_level << "\n";
+    return 1;
+  }
+
+  session::Options options;
+  options.optimization_level = optimization_level;
+  options.floating_point.no_signed_zeros = fast_math || no_signed_zeros;
+  options.floating_point.no_nans = fast_math || finite_math_only;
+  options.floating_point.no_infs = fast_math || finite_math_only;
+  options.floating_point.reassociate = fast_math || associative_math;
+  options.interprocedural.enabled = ipo;
+  options.interprocedural.inline_threshold = inline_limit;
+  options.interprocedural.size_level = size_level;
+  options.interprocedural.exports.assign(exports.begin(), exports.end());
+  options.vector_width = vector_width;
+  options.time_report = time_report;
+  options.time_trace = !time_trace.empty();
+  options.diagnostics.format = diagnostics_format;
+  // typing errors at the prompt should not end the session
+  bool prompting = load_bundle.empty() && write_bundle.empty()
+    && (input_files.empty() || (input_files.size() == 1 && input_files[0] == "-"));
+  options.diagnostics.max_errors = prompting && !max_errors.getNumOccurrences() ? 0 : max_errors.getValue();
 
-  utils::module = llvm::make_unique<llvm::Module>("Kaleidoscope JIT", utils::context);
+  // record the phases of the main thread, as the driver does for its threads
+  if (options.time_trace) {
+    timeTraceProfilerInitialize(0, argv[0]);
+  }
 
-  main_loop();
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+  InitializeNativeTargetAsmParser();
 
-  utils::module->print(errs(), nullptr);
+  // parse input files into a bundle, to run them later without parsing them
+  if (!write_bundle.empty()) {
+    session::CompilerSession session(options);
+    bool written = write_items_to_bundle(session);
+    if (print_stats || time_report) {
+      session.statistics.tokens = session.lexer.tokens_read;
+      print_statistics(session.statistics);
+    }
+    bool traced = write_time_trace();
+    return written && traced ? 0 : 1;
+  }
 
-  return 0;
+  // compile input files, if many or if asked to
+  if (input_files.size() > 1 || !output_file.empty() || emit.getNumOccurrences()) {
+    if (input_files.empty()) {
+      errs() << argv[0] << ": no input files to compile\n";
+      return 1;
+    }
+    const char *default_paths[] = { "a.o", "a.s", "a.bc", "a.ll" };
+    driver::Output output;
+    output.emit = emit;
+    output.path = output_file.empty() ? std::string(default_paths[(int) output.emit]) : output_file.getValue();
+    output.cpu = mcpu.empty() ? march : mcpu;
+    session::Statistics statistics;
+    bool compiled = driver::compile_files(input_files, jobs, options, output, statistics);
+    if (print_stats || time_report) {
+      print_statistics(statistics);
+    }
+    bool traced = write_time_trace();
+    return compiled && traced ? 0 : 1;
+  }
+
+  session::CompilerSession session(options);
+
+  // read source file, if any
+  if (!input_files.empty() && input_files[0] != "-") {
+    if (!session.lexer.open_file(input_files[0])) {
+      return 1;
+    }
+    interactive = false;
+  }
+
+  // there is no prompt once parsing runs ahead, nor when only running a
+  // bundle: standard input is read after one only if given as "-"
+  bool reading_input = load_bundle.empty() || !input_files.empty();
+  if (pipelined || !reading_input) {
+    interactive = false;
+  }
+
+  // cache object code for this configuration: the code also depends
+  // on the options and on the host, besides the source of definitions
+  if (!cache_directory.empty()) {
+    std::string configuration;
+    raw_string_ostream(configuration) << "O" << options.optimization_level
+      << " nsz" << options.floating_point.no_signed_zeros
+      << " nnan" << options.floating_point.no_nans
+      << " ninf" << options.floating_point.no_infs
+      << " reassoc" << options.floating_point.reassociate
+      << " " << sys::getProcessTriple() << " " << sys::getHostCPUName();
+    object_cache = std::make_unique<jit::ObjectCache>(cache_directory, configuration);
+  }
+
+  kaleidoscope_jit = exit_on_error(jit::KaleidoscopeJIT::create(object_cache.get()));
+  // report errors of code compiled as it is called (e.g. lazily) as the other errors
+  kaleidoscope_jit -> set_error_reporter([&session](Error error) {
+    logger::log_error(session, std::move(error));
+  });
+  target_machine = exit_on_error(jit::KaleidoscopeJIT::create_target_machine());
+  session.optimizer.set_target_machine(target_machine.get());
+
+  initialize_module(session);
+
+  // in batch mode, only the batch function and its callees need code
+  if (!batch_function.empty()) {
+    if (interactive && batch_input == "-") {
+      errs() << argv[0] << ": -batch needs an input file or a batch input file\n";
+      return 1;
+    }
+    lazy = true;
+  }
+
+  // run the bundle first, the input may use its definitions and operators
+  bool loaded = load_bundle.empty() || run_bundle_items(session);
+
+  pipeline::Report pipeline_report;
+  if (loaded && reading_input) {
+    prompt();
+    session.lexer.get_next_token();
+    if (pipelined) {
+      pipeline_report = pipelined_main_loop(session);
+    } else {
+      main_loop(session);
+    }
+  }
+
+  // the input was not read to its end past the error limit
+  bool succeeded = loaded && !session.too_many_errors() && (batch_function.empty() || run_batch(session));
+
+  optimizer::Optimizer::report_timings();
+
+  if (print_stats || time_report) {
+    session.statistics.tokens = session.lexer.tokens_read;
+    // definitions are compiled lazily: the ones never called are not misses
+    if (object_cache) {
+      session.statistics.cache_misses = object_cache -> get_misses();
+    }
+    print_statistics(session.statistics);
+    if (pipelined) {
+      pipeline_report.print();
+    }
+  }
+
+  bool traced = write_time_trace();
+  return succeeded && traced ? 0 : 1;
 }
@@ -0,0 +1,230 @@
+#include "Optimizer.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Analysis/InlineCost.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/Pass.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO/GlobalDCE.h"
+#include "llvm/Transforms/IPO/Inliner.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+#include "llvm/Transforms/IPO/SCCP.h"
+#include "llvm/Transforms/InstCombine/InstCombine.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Scalar/EarlyCSE.h"
+#include "llvm/Transforms/Scalar/GVN.h"
+#include "llvm/Transforms/Scalar/SROA.h"
+#include "llvm/Transforms/Scalar/SimplifyCFG.h"
+#include "llvm/Transforms/Utils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Vectorize.h"
+
+void optimizer::Optimizer::initialize(llvm::Module *module) {
+    function_pass_manager = std::make_unique<llvm::legacy::FunctionPassManager>(module);
+    // O0 - no optimization at all
+    if (level == 0) {
+        function_pass_manager -> doInitialization();
+        return;
+    }
+    // cost models of the target, if known
+    if (target_machine) {
+        function_pass_manager -> add(llvm::createTargetTransformInfoWrapperPass(target_machine -> getTargetIRAnalysis()));
+    }
+    // O1 - cheap cleanups
+    // promote memory to registers
+    function_pass_manager -> add(llvm::createPromoteMemoryToRegisterPass());
+    // peephole and bit-twiddling optimizations
+    function_pass_manager -> add(llvm::createInstructionCombiningPass());
+    // turn self-recursive tail calls into loops, mark other tail calls
+    function_pass_manager -> add(llvm::createTailCallEliminationPass());
+    // O2 - redundancy elimination
+    if (level >= 2) {
+        // break up aggregates
+        function_pass_manager -> add(llvm::createSROAPass());
+        // cheap common subexpression elimination
+        function_pass_manager -> add(llvm::createEarlyCSEPass());
+        // reassociate expressions to expose constants
+        function_pass_manager -> add(llvm::createReassociatePass());
+        // eliminate common subexpressions
+        function_pass_manager -> add(llvm::createGVNPass());
+        // hoist loop invariant code out of loops
+        function_pass_manager -> add(llvm::createLICMPass());
+        // turn floating point loop counters into integers, when exact
+        function_pass_manager -> add(llvm::createIndVarSimplifyPass());
+        // vectorize and unroll loops, then clean up
+        function_pass_manager -> add(llvm::createLoopVectorizePass());
+        function_pass_manager -> add(llvm::createLoopUnrollPass(level));
+        function_pass_manager -> add(llvm::createInstructionCombiningPass());
+    }
+    // O3 - more aggressive (and more expensive) simplifications
+    if (level >= 3) {
+        // propagate constants through the control flow graph
+        function_pass_manager -> add(llvm::createSCCPPass());
+        // remove dead code, assuming dead until proven otherwise
+        function_pass_manager -> add(llvm::createAggressiveDCEPass());
+        // clean up what the passes above exposed
+        function_pass_manager -> add(llvm::createInstructionCombiningPass());
+    }
+    // simplify control flow graph (delete unreachable blocks, etc.)
+    function_pass_manager -> add(llvm::createCFGSimplificationPass());
+    function_pass_manager -> doInitialization();
+}
+
+// inline the calls of function to always-inline functions of the module
+// (e.g. of operators), even at -O0: the inlined code is optimized already
+static void inline_always_inline_calls(llvm::Function &function) {
+    llvm::SmallVector<llvm::CallBase *, 8> calls;
+    for (auto &instruction : llvm::instructions(function)) {
+        auto *call = llvm::dyn_cast<llvm::CallBase>(&instruction);
+        llvm::Function *callee = call ? call -> getCalledFunction() : nullptr;
+        if (callee && callee != &function && !callee -> isDeclaration() && callee -> hasFnAttribute(llvm::Attribute::AlwaysInline)) {
+            calls.push_back(call);
+        }
+    }
+    for (auto *call : calls) {
+        llvm::InlineFunctionInfo info;
+        llvm::InlineFunction(*call, info);
+    }
+}
+
+void optimizer::Optimizer::run(llvm::Function &function) {
+    inline_always_inline_calls(function);
+    function_pass_manager -> run(function);
+}
+
+// This counts the call sites inlined, from the remarks of the inliners,
+// and hands every other diagnostic over to the handler it stands in for
+class InliningCounter : public llvm::DiagnosticHandler {
+
+    llvm::DiagnosticHandler &handler;
+
+    public:
+        unsigned inlined = 0;
+
+        InliningCounter(llvm::DiagnosticHandler &handler)
+            : handler(handler) {}
+
+        bool handleDiagnostics(const llvm::DiagnosticInfo &info) override {
+            if (auto *remark = llvm::dyn_cast<llvm::OptimizationRemark>(&info)) {
+                if (remark -> getRemarkName() == "Inlined") {
+                    inlined++;
+                }
+                // drop remarks only enabled for counting
+                if (!handler.isPassedOptRemarkEnabled(remark -> getPassName())) {
+                    return true;
+                }
+            }
+            return handler.handleDiagnostics(info);
+        }
+
+        bool isPassedOptRemarkEnabled(llvm::StringRef pass_name) const override {
+            return pass_name == "inline" || pass_name == "always-inline" || handler.isPassedOptRemarkEnabled(pass_name);
+        }
+
+        bool isAnyRemarkEnabled() const override {
+            return true;
+        }
+
+};
+
+// run module pass manager on module, return the number of call sites inlined
+static unsigned run_counting_inlined(llvm::ModulePassManager &module_pass_manager, llvm::Module &module,
+                                     llvm::ModuleAnalysisManager &module_analysis_manager) {
+    llvm::LLVMContext &context = module.getContext();
+    std::unique_ptr<llvm::DiagnosticHandler> handler = context.getDiagnosticHandler();
+    if (!handler) {
+        handler = std::make_unique<llvm::DiagnosticHandler>();
+    }
+    context.setDiagnosticHandler(std::make_unique<InliningCounter>(*handler));
+    module_pass_manager.run(module, module_analysis_manager);
+    unsigned inlined = static_cast<const InliningCounter *>(context.getDiagHandlerPtr()) -> inlined;
+    context.setDiagnosticHandler(std::move(handler));
+    return inlined;
+}
+
+// These are the analyses of a module pipeline, with target information for the cost models
+struct Analyses {
+
+    llvm::PassBuilder pass_builder;
+    llvm::LoopAnalysisManager loop_analysis_manager;
+    llvm::FunctionAnalysisManager function_analysis_manager;
+    llvm::CGSCCAnalysisManager cgscc_analysis_manager;
+    llvm::ModuleAnalysisManager module_analysis_manager;
+
+    Analyses(llvm::TargetMachine *target_machine)
+        : pass_builder(target_machine) {
+        pass_builder.registerModuleAnalyses(module_analysis_manager);
+        pass_builder.registerCGSCCAnalyses(cgscc_analysis_manager);
+        pass_builder.registerFunctionAnalyses(function_analysis_manager);
+        pass_builder.registerLoopAnalyses(loop_analysis_manager);
+        pass_builder.crossRegisterProxies(loop_analysis_manager, function_analysis_manager,
+            cgscc_analysis_manager, module_analysis_manager);
+    }
+
+};
+
+unsigned optimizer::Optimizer::optimize_module(llvm::Module &module, llvm::TargetMachine *target_machine, unsigned level) {
+    // O0 - no optimization at all
+    if (level == 0) {
+        return 0;
+    }
+    Analyses analyses(target_machine);
+    // standard pipeline of level
+    const llvm::OptimizationLevel levels[] = {
+        llvm::OptimizationLevel::O0, llvm::OptimizationLevel::O1,
+        llvm::OptimizationLevel::O2, llvm::OptimizationLevel::O3,
+    };
+    llvm::ModulePassManager module_pass_manager = analyses.pass_builder.buildPerModuleDefaultPipeline(levels[level]);
+    return run_counting_inlined(module_pass_manager, module, analyses.module_analysis_manager);
+}
+
+unsigned optimizer::Optimizer::optimize_interprocedural(llvm::Module &module, llvm::TargetMachine *target_machine,
+                                                        unsigned level, const InterproceduralOptions &options) {
+    // O0 - no optimization at all
+    if (level == 0) {
+        return 0;
+    }
+    // size attributes, that the inliner and code generation honour
+    for (auto &function : module) {
+        if (!function.isDeclaration() && options.size_level >= 1) {
+            function.addFnAttr(llvm::Attribute::OptimizeForSize);
+        }
+        if (!function.isDeclaration() && options.size_level >= 2) {
+            function.addFnAttr(llvm::Attribute::MinSize);
+        }
+    }
+    Analyses analyses(target_machine);
+    llvm::ModulePassManager module_pass_manager;
+    // make functions not exported internal
+    if (!options.exports.empty()) {
+        module_pass_manager.addPass(llvm::InternalizePass([&options](const llvm::GlobalValue &value) {
+            return llvm::is_contained(options.exports, value.getName());
+        }));
+    }
+    // propagate constants across functions (e.g. arguments of internal ones)
+    module_pass_manager.addPass(llvm::IPSCCPPass());
+    // inline calls bottom up the call graph, cleaning up every caller
+    // (inlined code is optimized already, but not for its call site)
+    llvm::InlineParams parameters = options.inline_threshold
+        ? llvm::getInlineParams(options.inline_threshold)
+        : llvm::getInlineParams(level, options.size_level);
+    llvm::ModuleInlinerWrapperPass inliner(parameters);
+    llvm::FunctionPassManager cleanup;
+    cleanup.addPass(llvm::SROAPass());
+    cleanup.addPass(llvm::EarlyCSEPass());
+    cleanup.addPass(llvm::InstCombinePass());
+    cleanup.addPass(llvm::SimplifyCFGPass());
+    inliner.getPM().addPass(llvm::createCGSCCToFunctionPassAdaptor(std::move(cleanup)));
+    module_pass_manager.addPass(std::move(inliner));
+    // remove functions (and globals) no longer used
+    module_pass_manager.addPass(llvm::GlobalDCEPass());
+    return run_counting_inlined(module_pass_manager, module, analyses.module_analysis_manager);
+}
+
+void optimizer::Optimizer::report_timings() {
+    llvm::reportAndResetTimings(&llvm::errs());
+}
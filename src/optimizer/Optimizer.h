@@ -0,0 +1,70 @@
+#ifndef __OPTIMIZER_H__
+#define __OPTIMIZER_H__
+
+#include <string>
+#include <vector>
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+namespace optimizer {
+
+    // Options of the interprocedural optimizations of a whole module
+    struct InterproceduralOptions {
+        // run them (on the module linked from the input files)
+        bool enabled = false;
+        // inline call sites whose callee costs less than this,
+        // 0 for the default threshold of the level
+        unsigned inline_threshold = 0;
+        // 0 = optimize for speed, 1 = for size (-Os), 2 = for minimum size (-Oz)
+        unsigned size_level = 0;
+        // functions the module exports, all of them if empty: the others
+        // become internal, so they can be removed once inlined everywhere
+        std::vector<std::string> exports;
+    };
+
+    // Optimizer runs a function pass pipeline on every function
+    // of a module, right after the function has been verified.
+    class Optimizer {
+
+        // Optimization level [0-3]. Higher levels run more
+        // passes: better code, slower compilation.
+        unsigned level;
+
+        // This is the pass pipeline of the current module
+        std::unique_ptr<llvm::legacy::FunctionPassManager> function_pass_manager;
+
+        // This is the machine code is compiled for, if known: its cost
+        // models tell e.g. the loop vectorizer how wide vectors are
+        llvm::TargetMachine *target_machine = nullptr;
+
+        public:
+            Optimizer(unsigned level = 2)
+                : level(level) {}
+            unsigned get_level() const { return level; }
+            // Optimize for target_machine, from the next module on
+            void set_target_machine(llvm::TargetMachine *machine) { target_machine = machine; }
+            // Create the function pass pipeline of the level for module
+            void initialize(llvm::Module *module);
+            // Optimize function of the module, inlining its calls
+            // to always-inline functions defined in the module first
+            void run(llvm::Function &function);
+            // Optimize whole module for target_machine with LLVM's standard
+            // pipeline of level (inlining, loop vectorization, ...).
+            // Return the number of call sites inlined.
+            static unsigned optimize_module(llvm::Module &module, llvm::TargetMachine *target_machine, unsigned level);
+            // Optimize module across its functions, whose code is optimized already:
+            // propagate constants into them (IPSCCP), inline calls and clean up
+            // the callers, then remove functions no longer called (global DCE).
+            // Return the number of call sites inlined.
+            static unsigned optimize_interprocedural(llvm::Module &module, llvm::TargetMachine *target_machine,
+                                                     unsigned level, const InterproceduralOptions &options);
+            // Print the time spent in each pass (if -time-passes is given)
+            static void report_timings();
+
+    };
+
+}
+
+#endif
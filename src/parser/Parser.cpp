@@ -1,212 +1,434 @@
 #include "Parser.h"
 
 #include "../logger/Logger.h"
-#include "../lexer/Lexer.h"
+#include "../session/Session.h"
 
-std::map<char, int> parser::binary_operator_precedences;
-
-// retrieve operator precedence
-static int get_current_token_precedence() {
-    // -1 if it is not an ascii character
-    if (!isascii(lexer::current_token)) {
-        return -1;
-    }
-    // retrieve token precedence 
-    int token_precedence = parser::binary_operator_precedences[lexer::current_token];
-    if (token_precedence <= 0) {
-        return -1;
-    }
-    // return token precedence
-    return token_precedence;
+// retrieve operator precedence, -1 if the current token is not a binary operator
+static int get_current_token_precedence(session::CompilerSession &session) {
+    // tokens other than characters are negative, past the end of the table as unsigned
+    unsigned token = session.lexer.current_token;
+    return token < session.binary_operator_precedences.size() ? session.binary_operator_precedences[token] : -1;
 }
 
 // parse expression
-std::unique_ptr<ast::Expression> parser::parse_expression() {
-    // parse primary expression
-    auto primary_expression = parse_primary_expression();
-    if (!primary_expression) {
+ast::Expression *parser::parse_expression(session::CompilerSession &session) {
+    // parse unary expression
+    auto unary_expression = parse_unary_expression(session);
+    if (!unary_expression) {
         return nullptr;
     }
     // parse possible right hand side if binary operation
-    return parse_binary_operation_rhs(0, std::move(primary_expression));
+    return parse_binary_operation_rhs(session, 0, unary_expression);
 }
 
 // parse binary expression right hand side
-std::unique_ptr<ast::Expression> parser::parse_binary_operation_rhs(
-    int previous_token_precedence, std::unique_ptr<ast::Expression> lhs
+ast::Expression *parser::parse_binary_operation_rhs(
+    session::CompilerSession &session, int previous_token_precedence, ast::Expression *lhs
 ) {
     while (1) {
         // retrieve current token precedence
-        int current_token_precedence = get_current_token_precedence();
+        int current_token_precedence = get_current_token_precedence(session);
         // lewer precedence - return left hand side
         if (current_token_precedence < previous_token_precedence) {
             return lhs;
         }
         // retrieve operator
-        int binary_operator = lexer::current_token;
+        int binary_operator = session.lexer.current_token;
         // consume operator
-        lexer::get_next_token();
+        session.lexer.get_next_token();
         // parse right hand side
-        auto rhs = parse_primary_expression();
+        auto rhs = parse_unary_expression(session);
         if (!rhs) {
             return nullptr;
         }
         // retrieve next token precedence
-        int next_token_precedence = get_current_token_precedence();
+        int next_token_precedence = get_current_token_precedence(session);
         // parse higer precedence right hand side expression
         if (current_token_precedence < next_token_precedence) {
             // parse right hand side with higher precedence
             rhs = parse_binary_operation_rhs(
-                current_token_precedence + 1, std::move(rhs)
+                session, current_token_precedence + 1, rhs
             );
             if (!rhs) {
                 return nullptr;
             }
         }
         // update left hand side expression
-        // lhs = llvm::make_unique<ast::BinaryOperation>(binary_operator, std::move(lhs), std::move(rhs));
-        lhs = llvm::make_unique<ast::BinaryOperation>(binary_operator, std::move(lhs), std::move(rhs));
+        lhs = session.arena -> make<ast::BinaryOperation>(binary_operator, lhs, rhs);
     }
 }
 
+// parse unary expression: unary operator applied to a unary expression, or primary expression
+ast::Expression *parser::parse_unary_expression(session::CompilerSession &session) {
+    // tokens other than characters are negative, past the end of the table as unsigned
+    unsigned token = session.lexer.current_token;
+    if (token >= session.unary_operators.size() || !session.unary_operators[token]) {
+        return parse_primary_expression(session);
+    }
+    // consume operator
+    session.lexer.get_next_token();
+    // parse operand
+    auto operand = parse_unary_expression(session);
+    if (!operand) {
+        return nullptr;
+    }
+    // return unary operation node
+    return session.arena -> make<ast::UnaryOperation>(token, operand);
+}
+
 // parse primary expression
-std::unique_ptr<ast::Expression> parser::parse_primary_expression() {
-    switch (lexer::current_token) {
+ast::Expression *parser::parse_primary_expression(session::CompilerSession &session) {
+    switch (session.lexer.current_token) {
         case lexer::Token::IDENTIFIER:
-            return parse_identifier_expression();
+            return parse_identifier_expression(session);
         case lexer::Token::NUMBER:
-            return parse_number_expression();
+            return parse_number_expression(session);
         case '(':
-            return parse_parenthesized_expression();
+            return parse_parenthesized_expression(session);
+        case lexer::Token::IF:
+            return parse_if_expression(session);
+        case lexer::Token::FOR:
+            return parse_for_expression(session);
+        case lexer::Token::VAR:
+            return parse_var_expression(session);
         default: 
-            return logger::log_expression_error("unknown token when expecting an expression");
+            return logger::log_expression_error(session, "unknown token when expecting an expression");
     }
 }
 
 // Parse number literal
-std::unique_ptr<ast::Expression> parser::parse_number_expression() {
+ast::Expression *parser::parse_number_expression(session::CompilerSession &session) {
     // create ast node
-    auto number_literal = llvm::make_unique<ast::NumberLiteral>(lexer::number);
+    auto number_literal = session.arena -> make<ast::NumberLiteral>(session.lexer.number);
     // consume number
-    lexer::get_next_token();
+    session.lexer.get_next_token();
     // return node
-    return std::move(number_literal);
+    return number_literal;
 }
 
 // Parse parenthesized expression
-std::unique_ptr<ast::Expression> parser::parse_parenthesized_expression() {
+ast::Expression *parser::parse_parenthesized_expression(session::CompilerSession &session) {
     // consume '('
-    lexer::get_next_token();
+    session.lexer.get_next_token();
     // parse inner expression
-    auto expression = parse_expression();
+    auto expression = parse_expression(session);
     if (!expression) {
         return nullptr;
     }
     // consume ')', throw error if absent
-    if (lexer::current_token != ')') {
-        return logger::log_expression_error("expected ')'");
+    if (session.lexer.current_token != ')') {
+        return logger::log_expression_error(session, "expected ')'");
     }
-    lexer::get_next_token();
+    session.lexer.get_next_token();
     // return inner node
     return expression;
 }
 
-std::unique_ptr<ast::Expression> parser::parse_identifier_expression() {
+ast::Expression *parser::parse_identifier_expression(session::CompilerSession &session) {
     // retrieve name
-    std::string identifier = lexer::identifier;
+    symbols::Symbol identifier = session.lexer.symbol;
     // consume variable name
-    lexer::get_next_token();
+    session.lexer.get_next_token();
     // variable reference
-    if (lexer::current_token != '(') {
-        return llvm::make_unique<ast::VariableReference>(identifier);
+    if (session.lexer.current_token != '(') {
+        return session.arena -> make<ast::VariableReference>(identifier);
     }
     // function call, consume '('
-    lexer::get_next_token();
+    session.lexer.get_next_token();
     // parse function call arguments
-    std::vector<std::unique_ptr<ast::Expression>> arguments;
-    if (lexer::current_token != ')') {
+    llvm::SmallVector<ast::Expression *, 8> arguments;
+    if (session.lexer.current_token != ')') {
         while (1) {
-            if (auto argument = parse_expression()) {
-                arguments.push_back(std::move(argument));
+            if (auto argument = parse_expression(session)) {
+                arguments.push_back(argument);
             } else {
                 return nullptr;
             }
             // break if no more parameters
-            if (lexer::current_token == ')') {
+            if (session.lexer.current_token == ')') {
                 break;
             }
             // error if no other argument
-            if (lexer::current_token != ',') {
-                return logger::log_expression_error("expected ')' or ',' in argument list");
+            if (session.lexer.current_token != ',') {
+                return logger::log_expression_error(session, "expected ')' or ',' in argument list");
             }
             // consume ','
-            lexer::get_next_token();
+            session.lexer.get_next_token();
         } 
     }
     // consume ')'
-    lexer::get_next_token();
+    session.lexer.get_next_token();
     // return function call node
-    return llvm::make_unique<ast::FunctionCall>(identifier, std::move(arguments));
+    return session.arena -> make<ast::FunctionCall>(identifier, session.arena -> copy<ast::Expression *>(arguments));
 }
 
-std::unique_ptr<ast::FunctionDeclaration> parser::parse_function_declaration() {
-    // error if no identifier
-    if (lexer::current_token != lexer::Token::IDENTIFIER) {
-        return logger::log_function_declaration_error("expected name in function prototype");
+// Parse if expression: if condition then expression else expression
+ast::Expression *parser::parse_if_expression(session::CompilerSession &session) {
+    // consume 'if'
+    session.lexer.get_next_token();
+    // parse condition
+    auto condition = parse_expression(session);
+    if (!condition) {
+        return nullptr;
+    }
+    // consume 'then', throw error if absent
+    if (session.lexer.current_token != lexer::Token::THEN) {
+        return logger::log_expression_error(session, "expected then");
+    }
+    session.lexer.get_next_token();
+    auto then_expression = parse_expression(session);
+    if (!then_expression) {
+        return nullptr;
+    }
+    // consume 'else', throw error if absent
+    if (session.lexer.current_token != lexer::Token::ELSE) {
+        return logger::log_expression_error(session, "expected else");
+    }
+    session.lexer.get_next_token();
+    auto else_expression = parse_expression(session);
+    if (!else_expression) {
+        return nullptr;
+    }
+    // return if expression node
+    return session.arena -> make<ast::IfExpression>(condition, then_expression, else_expression);
+}
+
+// Parse for expression: for identifier = start, end[, step] in body
+ast::Expression *parser::parse_for_expression(session::CompilerSession &session) {
+    // consume 'for'
+    session.lexer.get_next_token();
+    // retrieve variable name
+    if (session.lexer.current_token != lexer::Token::IDENTIFIER) {
+        return logger::log_expression_error(session, "expected identifier after for");
+    }
+    symbols::Symbol variable = session.lexer.symbol;
+    session.lexer.get_next_token();
+    // consume '='
+    if (session.lexer.current_token != '=') {
+        return logger::log_expression_error(session, "expected '=' after for");
+    }
+    session.lexer.get_next_token();
+    // parse start value
+    auto start = parse_expression(session);
+    if (!start) {
+        return nullptr;
+    }
+    // consume ','
+    if (session.lexer.current_token != ',') {
+        return logger::log_expression_error(session, "expected ',' after for start value");
+    }
+    session.lexer.get_next_token();
+    // parse end condition
+    auto end = parse_expression(session);
+    if (!end) {
+        return nullptr;
+    }
+    // parse optional step value
+    ast::Expression *step = nullptr;
+    if (session.lexer.current_token == ',') {
+        session.lexer.get_next_token();
+        step = parse_expression(session);
+        if (!step) {
+            return nullptr;
+        }
+    }
+    // consume 'in'
+    if (session.lexer.current_token != lexer::Token::IN) {
+        return logger::log_expression_error(session, "expected 'in' after for");
+    }
+    session.lexer.get_next_token();
+    // parse body
+    auto body = parse_expression(session);
+    if (!body) {
+        return nullptr;
+    }
+    // return for expression node
+    return session.arena -> make<ast::ForExpression>(variable, start, end, step, body);
+}
+
+// Parse var expression: var identifier[ = initializer], ... in body
+ast::Expression *parser::parse_var_expression(session::CompilerSession &session) {
+    // consume 'var'
+    session.lexer.get_next_token();
+    // parse variables, at least one
+    llvm::SmallVector<ast::VariableDefinition, 4> variables;
+    if (session.lexer.current_token != lexer::Token::IDENTIFIER) {
+        return logger::log_expression_error(session, "expected identifier after var");
+    }
+    while (1) {
+        symbols::Symbol name = session.lexer.symbol;
+        session.lexer.get_next_token();
+        // parse optional initializer
+        ast::Expression *initializer = nullptr;
+        if (session.lexer.current_token == '=') {
+            session.lexer.get_next_token();
+            initializer = parse_expression(session);
+            if (!initializer) {
+                return nullptr;
+            }
+        }
+        variables.push_back({ name, initializer });
+        // break if no more variables
+        if (session.lexer.current_token != ',') {
+            break;
+        }
+        // consume ','
+        session.lexer.get_next_token();
+        if (session.lexer.current_token != lexer::Token::IDENTIFIER) {
+            return logger::log_expression_error(session, "expected identifier list after var");
+        }
+    }
+    // consume 'in'
+    if (session.lexer.current_token != lexer::Token::IN) {
+        return logger::log_expression_error(session, "expected 'in' keyword after 'var'");
+    }
+    session.lexer.get_next_token();
+    // parse body
+    auto body = parse_expression(session);
+    if (!body) {
+        return nullptr;
+    }
+    // return var expression node
+    return session.arena -> make<ast::VarExpression>(session.arena -> copy<ast::VariableDefinition>(variables), body);
+}
+
+// parse operator of a declaration: 'unary' or 'binary', its character, then for
+// binary operators an optional precedence (30 by default), return its function
+static bool parse_operator(session::CompilerSession &session, symbols::Symbol &identifier, int &precedence) {
+    bool binary = session.lexer.current_token == lexer::Token::BINARY;
+    // consume 'unary' or 'binary'
+    session.lexer.get_next_token();
+    // error if not a character, or a character that already means something
+    int operator_character = session.lexer.current_token;
+    if (!session::is_operator_character(operator_character)) {
+        logger::log_function_declaration_error(session, "expected operator character");
+        return false;
+    }
+    if (binary && session::BUILTIN_BINARY_OPERATOR_PRECEDENCES[operator_character] >= 0) {
+        logger::log_function_declaration_error(session, "built-in binary operators cannot be redefined");
+        return false;
+    }
+    identifier = session.get_operator_function(binary ? "binary" : "unary", operator_character);
+    // consume operator
+    session.lexer.get_next_token();
+    if (!binary) {
+        return true;
+    }
+    precedence = 30;
+    // parse optional precedence
+    if (session.lexer.current_token == lexer::Token::NUMBER) {
+        if (session.lexer.number < session::MIN_PRECEDENCE || session.lexer.number > session::MAX_PRECEDENCE) {
+            logger::log_function_declaration_error(session, "invalid precedence: must be 1..100");
+            return false;
+        }
+        precedence = session.lexer.number;
+        session.lexer.get_next_token();
+    }
+    return true;
+}
+
+ast::FunctionDeclaration *parser::parse_function_declaration(session::CompilerSession &session) {
+    // 1 for unary operators, 2 for binary ones, 0 for other functions
+    unsigned operands = session.lexer.current_token == lexer::Token::UNARY ? 1
+        : session.lexer.current_token == lexer::Token::BINARY ? 2 : 0;
+    symbols::Symbol identifier;
+    int precedence = 0;
+    if (operands) {
+        if (!parse_operator(session, identifier, precedence)) {
+            return nullptr;
+        }
+    } else {
+        // error if no identifier
+        if (session.lexer.current_token != lexer::Token::IDENTIFIER) {
+            return logger::log_function_declaration_error(session, "expected name in function prototype");
+        }
+        // retrieve name
+        identifier = session.lexer.symbol;
+        // consume function name
+        session.lexer.get_next_token();
     }
-    // retrieve name
-    std::string identifier = lexer::identifier;
-    // consume function name
-    lexer::get_next_token();
     // error if no left parenthesis
-    if (lexer::current_token != '(') {
-        return logger::log_function_declaration_error("expected '(' in function prototype");
+    if (session.lexer.current_token != '(') {
+        return logger::log_function_declaration_error(session, "expected '(' in function prototype");
     }
     // parse arguments
-    std::vector<std::string> arguments;
-    while (lexer::get_next_token() == lexer::Token::IDENTIFIER) {
-        arguments.push_back(lexer::identifier);
+    llvm::SmallVector<symbols::Symbol, 8> arguments;
+    while (session.lexer.get_next_token() == lexer::Token::IDENTIFIER) {
+        arguments.push_back(session.lexer.symbol);
     }   
     // error if no closing parenthesis
-    if (lexer::current_token != ')') {
-        return logger::log_function_declaration_error("expected ')' in function prototype");
+    if (session.lexer.current_token != ')') {
+        return logger::log_function_declaration_error(session, "expected ')' in function prototype");
     }
     // consume ')'
-    lexer::get_next_token();
+    session.lexer.get_next_token();
+    // error if an operator has another number of operands
+    if (operands && arguments.size() != operands) {
+        return logger::log_function_declaration_error(session, "invalid number of operands for operator");
+    }
     // return function prototype node
-    return llvm::make_unique<ast::FunctionDeclaration>(identifier, arguments); 
+    return session.arena -> make<ast::FunctionDeclaration>(identifier,
+        session.arena -> copy<symbols::Symbol>(arguments), operands != 0, precedence);
+}
+
+// start a new arena for the top level item about to be parsed
+static std::unique_ptr<ast::Arena> start_arena(session::CompilerSession &session) {
+    auto arena = std::make_unique<ast::Arena>();
+    session.arena = arena.get();
+    return arena;
+}
+
+// hand arena over to the unit of the item parsed, counting its nodes
+template <typename T>
+static ast::Unit<T> finish_arena(session::CompilerSession &session, std::unique_ptr<ast::Arena> arena, T *root) {
+    session.statistics.ast_nodes += arena -> get_node_count();
+    return { std::move(arena), root };
 }
 
 // parse function definition
-std::unique_ptr<ast::FunctionDefinition> parser::parse_function_definition() {
+ast::Unit<ast::FunctionDefinition> parser::parse_function_definition(session::CompilerSession &session) {
+    auto arena = start_arena(session);
     // consume 'def'
-    lexer::get_next_token();
+    session.lexer.get_next_token();
     // parse function prototype
-    auto declaration = parse_function_declaration();
+    auto declaration = parse_function_declaration(session);
     if (!declaration) {
-        return nullptr;
+        return {};
     }
     // parse function body
-    if (auto body = parse_expression()) {
-        return llvm::make_unique<ast::FunctionDefinition>(std::move(declaration), std::move(body));
+    if (auto body = parse_expression(session)) {
+        auto definition = arena -> make<ast::FunctionDefinition>(declaration, body);
+        // the rest of the input parses with the operator, once its whole definition parsed
+        session.define_operator(*declaration);
+        return finish_arena(session, std::move(arena), definition);
     }
-    return nullptr;
+    return {};
 }
 
 // parse extern function
-std::unique_ptr<ast::FunctionDeclaration> parser::parse_extern_function() {
+ast::Unit<ast::FunctionDeclaration> parser::parse_extern_function(session::CompilerSession &session) {
+    auto arena = start_arena(session);
     // consume 'extern'
-    lexer::get_next_token();
+    session.lexer.get_next_token();
     // parse function prototype
-    return parse_function_declaration();
+    auto declaration = parse_function_declaration(session);
+    if (!declaration) {
+        return {};
+    }
+    // the rest of the input parses with the operator
+    session.define_operator(*declaration);
+    return finish_arena(session, std::move(arena), declaration);
 }
 
 // top level expressions - zero-argument anonymous functions
-std::unique_ptr<ast::FunctionDefinition> parser::parse_top_level_expression() {
-    if (auto expression = parse_expression()) {
+ast::Unit<ast::FunctionDefinition> parser::parse_top_level_expression(session::CompilerSession &session) {
+    auto arena = start_arena(session);
+    if (auto expression = parse_expression(session)) {
         // wrap expression into nullary anonymous function
-        auto declaration = llvm::make_unique<ast::FunctionDeclaration>("", std::vector<std::string>());
-        return llvm::make_unique<ast::FunctionDefinition>(std::move(declaration), std::move(expression));
+        auto name = session.symbol_table.intern("__anon_expr");
+        auto declaration = arena -> make<ast::FunctionDeclaration>(name, llvm::ArrayRef<symbols::Symbol>());
+        auto definition = arena -> make<ast::FunctionDefinition>(declaration, expression);
+        return finish_arena(session, std::move(arena), definition);
     }
-    return nullptr;
-}
\ No newline at end of file
+    return {};
+}
@@ -0,0 +1,9 @@
+#include "Pipeline.h"
+#include <cstdio>
+
+void pipeline::Report::print() const {
+    double serial_milliseconds = front_end_milliseconds + back_end_milliseconds;
+    fprintf(stderr, "pipeline: %u items, front end %.2f ms, back end %.2f ms, wall %.2f ms (%.2fx the throughput of serial)\n",
+        items, front_end_milliseconds, back_end_milliseconds, wall_milliseconds,
+        wall_milliseconds > 0 ? serial_milliseconds / wall_milliseconds : 1.0);
+}
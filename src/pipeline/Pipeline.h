@@ -0,0 +1,111 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "llvm/ADT/STLFunctionalExtras.h"
+
+namespace pipeline {
+
+    // BoundedQueue hands items over from a producer thread to a consumer
+    // thread, in order. The producer waits while the queue is full, so that
+    // it never gets more than capacity items ahead of the consumer.
+    template <typename T>
+    class BoundedQueue {
+
+        std::mutex mutex;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+        std::deque<T> items;
+        size_t capacity;
+        bool closed = false;
+
+        // This is the time the producer waited for room
+        std::chrono::steady_clock::duration producer_wait = {};
+
+        public:
+            BoundedQueue(size_t capacity)
+                : capacity(capacity ? capacity : 1) {}
+            // queue item, waiting for room
+            void push(T item) {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (items.size() >= capacity) {
+                    auto start = std::chrono::steady_clock::now();
+                    not_full.wait(lock, [this] { return items.size() < capacity; });
+                    producer_wait += std::chrono::steady_clock::now() - start;
+                }
+                items.push_back(std::move(item));
+                not_empty.notify_one();
+            }
+            // tell the consumer that no more items come
+            void close() {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+                not_empty.notify_one();
+            }
+            // retrieve next item, waiting for it, false once closed and empty
+            bool pop(T &item) {
+                std::unique_lock<std::mutex> lock(mutex);
+                not_empty.wait(lock, [this] { return !items.empty() || closed; });
+                if (items.empty()) {
+                    return false;
+                }
+                item = std::move(items.front());
+                items.pop_front();
+                not_full.notify_one();
+                return true;
+            }
+            std::chrono::steady_clock::duration get_producer_wait() {
+                std::lock_guard<std::mutex> lock(mutex);
+                return producer_wait;
+            }
+
+    };
+
+    // Report tells how long each stage of a pipeline run was busy: the
+    // stages run one after the other would take front_end + back_end
+    struct Report {
+        unsigned items = 0;
+        double front_end_milliseconds = 0;
+        double back_end_milliseconds = 0;
+        double wall_milliseconds = 0;
+
+        // print report to stderr
+        void print() const;
+    };
+
+    // Run produce on a thread of its own, queueing the items it produces, while
+    // consume runs on the calling thread on every item, in the order produced.
+    // The queue holds at most capacity items: produce then waits for consume.
+    template <typename T>
+    Report run(size_t capacity, llvm::function_ref<void(BoundedQueue<T> &)> produce,
+               llvm::function_ref<void(T &)> consume) {
+        using milliseconds = std::chrono::duration<double, std::milli>;
+        Report report;
+        BoundedQueue<T> queue(capacity);
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration front_end;
+        std::thread front_end_thread([&] {
+            produce(queue);
+            queue.close();
+            front_end = std::chrono::steady_clock::now() - start;
+        });
+        T item;
+        while (queue.pop(item)) {
+            auto item_start = std::chrono::steady_clock::now();
+            consume(item);
+            report.back_end_milliseconds += milliseconds(std::chrono::steady_clock::now() - item_start).count();
+            report.items++;
+        }
+        front_end_thread.join();
+        report.wall_milliseconds = milliseconds(std::chrono::steady_clock::now() - start).count();
+        report.front_end_milliseconds = milliseconds(front_end - queue.get_producer_wait()).count();
+        return report;
+    }
+
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include "Profiler.h"
+#include <sys/resource.h>
+#include "llvm/Support/TimeProfiler.h"
+
+static const char *const names[profiler::PHASES] = {
+    "parse", "simplify", "codegen", "verify", "optimize", "print", "jit", "run",
+};
+
+static const char *const descriptions[profiler::PHASES] = {
+    "Lexing and parsing",
+    "AST simplification",
+    "IR generation",
+    "IR verification",
+    "Function optimization",
+    "IR printing",
+    "JIT compilation",
+    "Top level expression runs",
+};
+
+profiler::Profiler::Profiler()
+    : group("kaleidoscope", "Kaleidoscope phases") {
+    for (unsigned phase = 0; phase < PHASES; phase++) {
+        timers[phase].init(names[phase], descriptions[phase], group);
+    }
+}
+
+void profiler::Profiler::start(Phase phase) {
+    // pause enclosing phase
+    if (!running.empty()) {
+        timers[running.back()].stopTimer();
+    }
+    running.push_back(phase);
+    timers[phase].startTimer();
+}
+
+void profiler::Profiler::stop() {
+    timers[running.back()].stopTimer();
+    running.pop_back();
+    // resume enclosing phase
+    if (!running.empty()) {
+        timers[running.back()].startTimer();
+    }
+}
+
+profiler::Scope::Scope(Profiler *profiler, Phase phase, llvm::StringRef detail)
+    : profiler(profiler), tracing(llvm::timeTraceProfilerEnabled()) {
+    if (profiler) {
+        profiler -> start(phase);
+    }
+    if (tracing) {
+        llvm::timeTraceProfilerBegin(names[phase], detail);
+    }
+}
+
+profiler::Scope::~Scope() {
+    if (tracing) {
+        llvm::timeTraceProfilerEnd();
+    }
+    if (profiler) {
+        profiler -> stop();
+    }
+}
+
+size_t profiler::get_peak_memory() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+#ifdef __APPLE__
+    // bytes on macOS, kilobytes elsewhere
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
@@ -0,0 +1,65 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <cstddef>
+#include <vector>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Timer.h"
+
+namespace profiler {
+
+    // Phases of the compilation of a top level item
+    enum Phase {
+        PARSE,    // lexing and parsing
+        SIMPLIFY, // simplification of the AST
+        CODEGEN,  // generation of LLVM IR
+        VERIFY,   // verification of the IR
+        OPTIMIZE, // function passes of the optimizer
+        PRINT,    // printing of the IR
+        JIT,      // hand over to the JIT and compilation to machine code
+        RUN,      // run of top level expressions
+        PHASES,
+    };
+
+    // Profiler measures the wall and CPU time spent in every phase.
+    // Phases nest (e.g. code generation verifies and optimizes functions):
+    // time is only counted in the innermost phase running, so that the
+    // times of the phases add up. The times are reported on stderr (like
+    // LLVM's -time-passes) when the profiler is destroyed.
+    class Profiler {
+
+        llvm::TimerGroup group;
+        llvm::Timer timers[PHASES];
+
+        // These are the phases running, innermost last
+        std::vector<Phase> running;
+
+        public:
+            Profiler();
+            void start(Phase phase);
+            void stop();
+
+    };
+
+    // Scope runs a phase until the end of the scope, if there is a profiler,
+    // and records it as an event of the time trace, if it is enabled
+    // (detail, e.g. the function compiled, is shown with the event).
+    class Scope {
+
+        Profiler *profiler;
+        bool tracing;
+
+        public:
+            Scope(Profiler *profiler, Phase phase, llvm::StringRef detail = "");
+            ~Scope();
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+    };
+
+    // peak resident set size of the process so far, in kilobytes
+    size_t get_peak_memory();
+
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include "Session.h"
+
+session::Statistics &session::Statistics::operator+=(const Statistics &other) {
+    tokens += other.tokens;
+    ast_nodes += other.ast_nodes;
+    ir_instructions += other.ir_instructions;
+    simplified_nodes += other.simplified_nodes;
+    inlined_calls += other.inlined_calls;
+    cache_hits += other.cache_hits;
+    cache_misses += other.cache_misses;
+    deferred_definitions += other.deferred_definitions;
+    generated_definitions += other.generated_definitions;
+    return *this;
+}
+
+void session::Statistics::print() const {
+    fprintf(stderr, "front end: %u tokens, %u AST nodes, %u IR instructions\n", tokens, ast_nodes, ir_instructions);
+    fprintf(stderr, "simplifier: %u AST nodes removed\n", simplified_nodes);
+    fprintf(stderr, "inliner: %u call sites inlined\n", inlined_calls);
+    fprintf(stderr, "object cache: %u hits, %u misses\n", cache_hits, cache_misses);
+    fprintf(stderr, "lazy compilation: %u definitions deferred, %u generated\n",
+        deferred_definitions, generated_definitions);
+}
+
+session::CompilerSession::CompilerSession(const Options &options)
+    : lexer(symbol_table), optimizer(options.optimization_level), options(options) {
+    if (options.time_report) {
+        profiler = std::make_unique<profiler::Profiler>();
+    }
+}
+
+void session::CompilerSession::initialize_module(const std::string &name) {
+    // drop current module, if not handed over, before its context
+    module.reset();
+    builder.reset();
+    context = std::make_unique<llvm::LLVMContext>();
+    builder = std::make_unique<llvm::IRBuilder<>>(*context);
+    // let LLVM relax floating point semantics as much as the simplifier
+    llvm::FastMathFlags flags;
+    flags.setNoSignedZeros(options.floating_point.no_signed_zeros);
+    flags.setNoNaNs(options.floating_point.no_nans);
+    flags.setNoInfs(options.floating_point.no_infs);
+    flags.setAllowReassoc(options.floating_point.reassociate);
+    builder -> setFastMathFlags(flags);
+    module = std::make_unique<llvm::Module>(name, *context);
+    module_functions.clear();
+    optimizer.initialize(module.get());
+}
+
+llvm::Type *session::CompilerSession::get_value_type() const {
+    llvm::Type *double_type = llvm::Type::getDoubleTy(*context);
+    if (vector_width == 1) {
+        return double_type;
+    }
+    return llvm::FixedVectorType::get(double_type, vector_width);
+}
+
+std::string session::CompilerSession::get_function_name(symbols::Symbol function) const {
+    std::string name = symbol_table.get_name(function).str();
+    if (vector_width == 1) {
+        return name;
+    }
+    // e.g. f.v4, identifiers cannot contain dots
+    return name + ".v" + std::to_string(vector_width);
+}
+
+symbols::Symbol session::CompilerSession::get_operator_function(llvm::StringRef kind, char operator_character) {
+    return symbol_table.intern(kind.str() + operator_character);
+}
+
+void session::CompilerSession::define_operator(const ast::FunctionDeclaration &declaration) {
+    if (!declaration.is_operator()) {
+        return;
+    }
+    // functions of operators are named after their character, e.g. binary|
+    unsigned char operator_character = symbol_table.get_name(declaration.get_name()).back();
+    if (declaration.get_arguments().size() == 1) {
+        unary_operators[operator_character] = true;
+    } else {
+        binary_operator_precedences[operator_character] = declaration.get_precedence();
+    }
+}
+
+void session::CompilerSession::undefine_operator(const ast::FunctionDeclaration &declaration,
+    const ast::FunctionDeclaration *previous) {
+    if (!declaration.is_operator()) {
+        return;
+    }
+    if (previous) {
+        define_operator(*previous);
+        return;
+    }
+    unsigned char operator_character = symbol_table.get_name(declaration.get_name()).back();
+    if (declaration.get_arguments().size() == 1) {
+        unary_operators[operator_character] = false;
+    } else {
+        binary_operator_precedences[operator_character] = BUILTIN_BINARY_OPERATOR_PRECEDENCES[operator_character];
+    }
+}
+
+void session::CompilerSession::simplify(const ast::Unit<ast::FunctionDefinition> &definition) {
+    if (optimizer.get_level() == 0) {
+        return;
+    }
+    ast::Simplifier simplifier(definition.get_arena(), options.floating_point);
+    definition -> simplify(simplifier);
+    statistics.simplified_nodes += simplifier.get_removed_nodes();
+}
+
+void session::CompilerSession::declare_function(const ast::FunctionDeclaration &declaration) {
+    function_declarations.set(declaration.get_name(), declaration.clone(declarations));
+}
+
+
+void session::CompilerSession::define_function(const ast::Unit<ast::FunctionDefinition> &definition) {
+    function_definitions.set(definition -> get_declaration() -> get_name(), definition);
+}
\ No newline at end of file
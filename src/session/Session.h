@@ -0,0 +1,230 @@
+#ifndef __SESSION_H__
+#define __SESSION_H__
+
+#include <array>
+#include <atomic>
+#include <string>
+#include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Type.h"
+#include "llvm/IR/Verifier.h"
+#include "../ast/AST.h"
+#include "../ast/Simplifier.h"
+#include "../lexer/Lexer.h"
+#include "../logger/Logger.h"
+#include "../optimizer/Optimizer.h"
+#include "../profiler/Profiler.h"
+#include "../symbols/Symbols.h"
+
+namespace session {
+
+    // Precedence of the built-in binary operators, indexed by operator
+    // character, -1 if not an operator (higher value <=> higher precedence)
+    constexpr std::array<int, 256> BUILTIN_BINARY_OPERATOR_PRECEDENCES = [] {
+        std::array<int, 256> precedences = {};
+        for (int &precedence : precedences) {
+            precedence = -1;
+        }
+        precedences['='] = 2; // lowest precedence
+        precedences['<'] = 10;
+        precedences['+'] = 20;
+        precedences['-'] = 20;
+        precedences['*'] = 30; // highest precedence
+        return precedences;
+    }();
+
+    // Whether character (a token) can be the operator of a definition: not a token
+    // other than a character, nor a character that already means something
+    constexpr bool is_operator_character(int character) {
+        return character > 0 && character < 128 && character != '(' && character != ')'
+            && character != ',' && character != ';';
+    }
+
+    // Precedences binary operators may be defined with (30 if not given)
+    constexpr int MIN_PRECEDENCE = 1;
+    constexpr int MAX_PRECEDENCE = 100;
+
+    // Options of a session, set from the command line
+    struct Options {
+        // optimization level [0-3]
+        unsigned optimization_level = 2;
+        // floating point semantics that simplification
+        // and code generation must preserve
+        ast::FloatingPointOptions floating_point;
+        // interprocedural optimizations of the compiled module
+        optimizer::InterproceduralOptions interprocedural;
+        // width of the vectors batch kernels evaluate functions on
+        // (0 = widest the host CPU supports, 1 = no vectors)
+        unsigned vector_width = 0;
+        // time the phases of compilation, and report the times
+        bool time_report = false;
+        // record the phases in the time trace (on every thread compiling)
+        bool time_trace = false;
+        // format of the errors, and how many to report before giving up on the input
+        logger::DiagnosticOptions diagnostics;
+    };
+
+    // Statistics counts what a session did, so it can be reported
+    struct Statistics {
+        // tokens lexed, AST nodes allocated by the parser, IR instructions
+        // generated (before optimization)
+        unsigned tokens = 0;
+        unsigned ast_nodes = 0;
+        unsigned ir_instructions = 0;
+        // AST nodes removed by simplification
+        unsigned simplified_nodes = 0;
+        // call sites inlined by module optimizations
+        unsigned inlined_calls = 0;
+        // definitions loaded from the object cache, or compiled and cached
+        unsigned cache_hits = 0;
+        unsigned cache_misses = 0;
+        // definitions whose code generation was deferred, and then generated
+        unsigned deferred_definitions = 0;
+        unsigned generated_definitions = 0;
+
+        Statistics &operator+=(const Statistics &other);
+        // print statistics to stderr
+        void print() const;
+    };
+
+    // A compiler session owns all the state needed to compile one input:
+    // the lexer, the parser tables and the code generation state. Sessions
+    // share nothing with each other, so each one can run on its own thread
+    // (e.g. one per input file, see driver/Driver.h).
+    //
+    // A session is itself used by two threads with -pipeline: the front end
+    // parses items on a thread of its own, while the back end generates code
+    // for them and runs them on the main thread, in order. Then:
+    //  - the front end alone uses the lexer, arena, binary_operator_precedences,
+    //    unary_operators (the back end does not undo the operators of failed
+    //    definitions) and statistics.ast_nodes;
+    //  - the back end alone uses the code generation state (context, builder,
+    //    module, scope, function tables, optimizer, profiler), item_location,
+    //    item_source and the other statistics; it only reads the source name
+    //    of the lexer, which does not change once the input is opened;
+    //  - the front end interns symbols while the back end reads their names:
+    //    interning locks, while get_name() reads any symbol interned before
+    //    (e.g. one handed over with an item) without locking, names never move;
+    //  - both report errors, counted by the atomic errors; options are read-only.
+    // Items are handed over through a queue (see pipeline/Pipeline.h), which
+    // makes what the front end wrote into an item visible to the back end.
+    class CompilerSession {
+
+        public:
+            // This interns the identifiers of the session
+            symbols::SymbolTable symbol_table;
+
+            // This is the lexer reading the input of the session
+            lexer::Lexer lexer;
+
+            // This holds the precedence of every binary operator, indexed by
+            // operator character (-1 if not an operator): the built-in ones,
+            // and the ones defined by the input
+            std::array<int, 256> binary_operator_precedences = BUILTIN_BINARY_OPERATOR_PRECEDENCES;
+
+            // This tells which characters are unary operators (all defined by the input)
+            std::array<bool, 256> unary_operators = {};
+
+            // This is the arena of the top level item being parsed
+            ast::Arena *arena = nullptr;
+
+            // This is an object that owns LLVM core data structures
+            std::unique_ptr<llvm::LLVMContext> context;
+
+            // This is an helper object that makes easy to generate LLVM instructions
+            std::unique_ptr<llvm::IRBuilder<>> builder;
+
+            // This is an LLVM construct that contains functions and global variables
+            std::unique_ptr<llvm::Module> module;
+
+            // This is the width of the values code is generated for: 1 for doubles,
+            // N for vectors of N doubles (functions then work on N rows at once)
+            unsigned vector_width = 1;
+
+            // This map keeps track of the variables of the current scope: every
+            // variable lives in a stack slot of the entry block of the function,
+            // so that it can be assigned (mem2reg turns slots into registers)
+            symbols::SymbolMap<llvm::AllocaInst *> scope;
+
+            // This map keeps track of the functions declared in the current module
+            symbols::SymbolMap<llvm::Function *> module_functions;
+
+            // This map keeps the most recent declaration of every function, so that
+            // it can be re-declared in modules other than the one defining it.
+            // Declarations are copied into an arena of the session to outlive their items.
+            symbols::SymbolMap<ast::FunctionDeclaration *> function_declarations;
+            ast::Arena declarations;
+
+            // This keeps the most recent definition of every function,
+            // e.g. to generate its code again together with its callers
+            symbols::SymbolMap<ast::Unit<ast::FunctionDefinition>> function_definitions;
+
+            // This optimizes every function of the current module
+            optimizer::Optimizer optimizer;
+
+            // These are the options of the session
+            const Options options;
+
+            // This times the phases of compilation, if asked to
+            std::unique_ptr<profiler::Profiler> profiler;
+
+            // These count what the session did so far
+            Statistics statistics;
+
+            // This counts the errors reported so far (by any thread)
+            std::atomic<unsigned> errors = 0;
+
+            // This is the position of the top level item code is generated for,
+            // where errors of code generation are reported, and its file if not
+            // the one lexed (e.g. an item loaded from a bundle)
+            lexer::Location item_location = { 1, 1 };
+            std::string item_source;
+
+            CompilerSession(const Options &options = Options());
+
+            // Create a fresh context, builder and module. Each module can be handed
+            // over (e.g. to the JIT) together with its context once its code is generated.
+            void initialize_module(const std::string &name = "Kaleidoscope JIT");
+
+            // Type of the values code is generated for (double or vector of doubles)
+            llvm::Type *get_value_type() const;
+
+            // Name of the code of function for the current vector width
+            std::string get_function_name(symbols::Symbol function) const;
+
+            // Whether the error limit is reached, and the rest of the input is to be skipped
+            bool too_many_errors() const {
+                return options.diagnostics.max_errors && errors >= options.diagnostics.max_errors;
+            }
+
+            // Symbol of the function of operator character, of kind "unary" or "binary"
+            symbols::Symbol get_operator_function(llvm::StringRef kind, char operator_character);
+
+            // If declaration is the function of an operator, make the operator parse in the rest of the input
+            void define_operator(const ast::FunctionDeclaration &declaration);
+
+            // Undo define_operator(declaration), whose definition failed: the operator parses
+            // as declared by previous (the declaration before, if any), or not at all
+            void undefine_operator(const ast::FunctionDeclaration &declaration, const ast::FunctionDeclaration *previous);
+
+            // Simplify definition before code generation (unless optimizations are off)
+            void simplify(const ast::Unit<ast::FunctionDefinition> &definition);
+
+            // Record declaration as the most recent one of its function
+            void declare_function(const ast::FunctionDeclaration &declaration);
+
+            // Record definition as the most recent one of its function
+            void define_function(const ast::Unit<ast::FunctionDefinition> &definition);
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,40 @@
+#include "Symbols.h"
+
+symbols::SymbolTable::SymbolTable() {
+    // keywords, in the order of their symbols
+    intern("def");
+    intern("extern");
+    intern("if");
+    intern("then");
+    intern("else");
+    intern("for");
+    intern("in");
+    intern("var");
+    intern("binary");
+    intern("unary");
+}
+
+symbols::SymbolTable::~SymbolTable() {
+    for (auto &chunk : chunks) {
+        delete[] chunk.load();
+    }
+}
+
+symbols::Symbol symbols::SymbolTable::intern(llvm::StringRef name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Symbol symbol = count.load(std::memory_order_relaxed);
+    auto inserted = symbols.try_emplace(name, symbol);
+    if (!inserted.second) {
+        return inserted.first -> getValue();
+    }
+    // new identifier, its name is the key stored in the map
+    unsigned chunk = get_chunk(symbol);
+    llvm::StringRef *names = chunks[chunk].load(std::memory_order_relaxed);
+    if (!names) {
+        names = new llvm::StringRef[FIRST_CHUNK << chunk];
+        chunks[chunk].store(names, std::memory_order_release);
+    }
+    names[get_index(symbol, chunk)] = inserted.first -> getKey();
+    count.store(symbol + 1, std::memory_order_release);
+    return symbol;
+}
@@ -0,0 +1,102 @@
+#ifndef __SYMBOLS_H__
+#define __SYMBOLS_H__
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MathExtras.h"
+
+namespace symbols {
+
+    // Symbol is the small integer id of an interned identifier.
+    // Equal identifiers have equal symbols, so comparing and
+    // looking up identifiers never compares strings.
+    typedef unsigned Symbol;
+
+    // Symbols of the keywords, interned before anything else
+    enum Keyword : Symbol {
+        DEFINITION = 0, // def
+        EXTERN     = 1, // extern
+        IF         = 2, // if
+        THEN       = 3, // then
+        ELSE       = 4, // else
+        FOR        = 5, // for
+        IN         = 6, // in
+        VAR        = 7, // var
+        BINARY     = 8, // binary
+        UNARY      = 9, // unary
+        KEYWORDS   = 10, // number of keywords
+    };
+
+    // SymbolTable interns identifiers: every distinct identifier
+    // is hashed once, when first seen, and gets the next symbol.
+    // The table can be shared by threads (e.g. a parser interning
+    // identifiers while code is generated for previous items): only
+    // interning locks, names are read without a lock, in O(1).
+    class SymbolTable {
+
+        // Names are kept in chunks that never move once allocated, chunk c
+        // holding FIRST_CHUNK << c names, so that a name can be read while
+        // another one is interned. Names point to the keys of the map.
+        static constexpr unsigned FIRST_CHUNK = 256;
+        static constexpr unsigned CHUNKS = 24;
+
+        llvm::StringMap<Symbol> symbols;
+        std::atomic<llvm::StringRef *> chunks[CHUNKS] = {};
+        std::atomic<size_t> count = 0;
+        std::mutex mutex;
+
+        // chunk of symbol, and its index in the chunk
+        static unsigned get_chunk(Symbol symbol) { return llvm::Log2_32(symbol / FIRST_CHUNK + 1); }
+        static unsigned get_index(Symbol symbol, unsigned chunk) { return symbol - FIRST_CHUNK * ((1u << chunk) - 1); }
+
+        public:
+            SymbolTable();
+            ~SymbolTable();
+            // retrieve symbol of name, interning it if new
+            Symbol intern(llvm::StringRef name);
+            // retrieve name of symbol
+            llvm::StringRef get_name(Symbol symbol) const {
+                unsigned chunk = get_chunk(symbol);
+                return chunks[chunk].load(std::memory_order_acquire)[get_index(symbol, chunk)];
+            }
+            // number of symbols interned so far
+            size_t size() const { return count.load(std::memory_order_acquire); }
+
+    };
+
+    // SymbolMap maps symbols to values in a flat array indexed by symbol.
+    // Lookups and updates are O(1), and clearing only resets the symbols
+    // that were set, so scopes can be cleared for every function cheaply.
+    template <typename T>
+    class SymbolMap {
+
+        std::vector<T> values;
+        std::vector<Symbol> assigned;
+
+        public:
+            // retrieve value of symbol, null if none
+            T lookup(Symbol symbol) const { return symbol < values.size() ? values[symbol] : T(); }
+            // set value of symbol
+            void set(Symbol symbol, T value) {
+                if (symbol >= values.size()) {
+                    values.resize(symbol + 1);
+                }
+                values[symbol] = value;
+                assigned.push_back(symbol);
+            }
+            // reset value of every symbol
+            void clear() {
+                for (Symbol symbol : assigned) {
+                    values[symbol] = T();
+                }
+                assigned.clear();
+            }
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Run the .kal tests of this directory with the compiler given (default ../main),
+# comparing what they print with their .expected file.
+#
+# Every "# RUN: <arguments>" line of a test runs the compiler with arguments,
+# in order, where %s is the test file and %t a temporary file of the test.
+# The runs print to stderr: their results, diagnostics and statistics (IR
+# dumps left out) and their exit status if not 0 are compared with the
+# .expected file, and must match.
+#
+# usage: tests/run.sh [compiler] [test.kal ...]
+
+cd "$(dirname "$0")"
+compiler=$(cd .. && realpath "${1:-main}")
+[ $# -gt 0 ] && shift
+tests=${*:-$(ls *.kal)}
+temporary=$(mktemp -d)
+trap 'rm -rf "$temporary"' EXIT
+
+failed=0
+for test in $tests; do
+    name=${test%.kal}
+    output="$temporary/$name.output"
+    : > "$output"
+    grep '^# RUN:' "$test" | sed 's/^# RUN: *//' | while read -r arguments; do
+        arguments=$(echo "$arguments" | sed "s|%s|$test|g; s|%t|$temporary/$name|g")
+        eval "\"$compiler\" $arguments" < /dev/null > /dev/null 2> "$temporary/stderr"
+        status=$?
+        grep -E '^(Evaluated to|Loaded a cached|simplifier:|object cache:|\{)|error:' "$temporary/stderr" \
+            | sed "s|$temporary/||g" >> "$output"
+        if [ $status -ne 0 ]; then
+            echo "exit status $status" >> "$output"
+        fi
+    done
+    if diff -u "$name.expected" "$output" > "$temporary/$name.diff"; then
+        echo "PASS $name"
+    else
+        echo "FAIL $name"
+        cat "$temporary/$name.diff"
+        failed=$((failed + 1))
+    fi
+done
+if [ $failed -ne 0 ]; then
+    echo "$failed test(s) failed"
+    exit 1
+fi